@@ -0,0 +1,150 @@
+#pragma once
+
+#include "graph.h"
+
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace Graph {
+
+  // Common interface of all routers over DirectedWeightedGraph.
+  // Routers differ in what they precompute, but all of them expose
+  // the built route as a sequence of original graph edges.
+  // Routes may be built, read and released from several threads.
+  template <typename Weight>
+  class BaseRouter {
+  public:
+    using RouteId = uint64_t;
+
+    struct RouteInfo {
+      RouteId id;
+      Weight weight;
+      size_t edge_count;
+    };
+
+    // Route kept by the router while the object lives
+    class ScopedRoute {
+    public:
+      ScopedRoute() = default;
+      ScopedRoute(const BaseRouter& router, const RouteInfo& info) : router_(&router), info_(info) {}
+      ScopedRoute(ScopedRoute&& other) noexcept : router_(std::exchange(other.router_, nullptr)), info_(other.info_) {}
+      ScopedRoute& operator=(ScopedRoute&& other) noexcept;
+      ~ScopedRoute() { Release(); }
+
+      // False if there is no route
+      explicit operator bool() const { return router_ != nullptr; }
+      const RouteInfo& operator*() const { return info_; }
+      const RouteInfo* operator->() const { return &info_; }
+      EdgeId GetEdge(size_t edge_idx) const { return router_->GetRouteEdge(info_.id, edge_idx); }
+
+    private:
+      void Release();
+
+      const BaseRouter* router_ = nullptr;
+      RouteInfo info_{};
+    };
+
+    virtual ~BaseRouter() = default;
+
+    // Writes edges of the route into edges, which is cleared first, and
+    // returns weight of the route. Nothing is kept in the router, so with
+    // one buffer for many calls routes are built without allocations
+    virtual std::optional<Weight> BuildRouteEdges(VertexId from, VertexId to, std::vector<EdgeId>& edges) const = 0;
+    // Keeps edges of the route until ReleaseRoute
+    std::optional<RouteInfo> BuildRoute(VertexId from, VertexId to) const;
+    ScopedRoute BuildScopedRoute(VertexId from, VertexId to) const;
+    // Weights of routes from every source to every target, row by row.
+    // Routes are not expanded, routers override it with searches
+    // that serve many pairs at once
+    virtual std::vector<std::optional<Weight>> BuildWeightMatrix(const std::vector<VertexId>& sources,
+                                                                 const std::vector<VertexId>& targets) const;
+    EdgeId GetRouteEdge(RouteId route_id, size_t edge_idx) const;
+    void ReleaseRoute(RouteId route_id) const;
+
+  private:
+    RouteInfo SaveExpandedRoute(Weight weight, std::vector<EdgeId> edges) const;
+
+    using ExpandedRoute = std::vector<EdgeId>;
+    mutable std::mutex cache_mutex_;
+    mutable RouteId next_route_id_ = 0;
+    mutable std::unordered_map<RouteId, ExpandedRoute> expanded_routes_cache_;
+  };
+
+
+  template <typename Weight>
+  std::vector<std::optional<Weight>> BaseRouter<Weight>::BuildWeightMatrix(const std::vector<VertexId>& sources,
+                                                                           const std::vector<VertexId>& targets) const {
+    std::vector<std::optional<Weight>> weights;
+    weights.reserve(sources.size() * targets.size());
+    std::vector<EdgeId> edges;
+    for (const VertexId from : sources) {
+      for (const VertexId to : targets) {
+        weights.push_back(BuildRouteEdges(from, to, edges));
+      }
+    }
+    return weights;
+  }
+
+  template <typename Weight>
+  std::optional<typename BaseRouter<Weight>::RouteInfo> BaseRouter<Weight>::BuildRoute(VertexId from,
+                                                                                        VertexId to) const {
+    std::vector<EdgeId> edges;
+    const std::optional<Weight> weight = BuildRouteEdges(from, to, edges);
+    if (!weight) {
+      return std::nullopt;
+    }
+    return SaveExpandedRoute(*weight, std::move(edges));
+  }
+
+  template <typename Weight>
+  typename BaseRouter<Weight>::ScopedRoute BaseRouter<Weight>::BuildScopedRoute(VertexId from, VertexId to) const {
+    const auto route = BuildRoute(from, to);
+    return route ? ScopedRoute(*this, *route) : ScopedRoute();
+  }
+
+  template <typename Weight>
+  typename BaseRouter<Weight>::ScopedRoute&
+  BaseRouter<Weight>::ScopedRoute::operator=(ScopedRoute&& other) noexcept {
+    if (this != &other) {
+      Release();
+      router_ = std::exchange(other.router_, nullptr);
+      info_ = other.info_;
+    }
+    return *this;
+  }
+
+  template <typename Weight>
+  void BaseRouter<Weight>::ScopedRoute::Release() {
+    if (router_) {
+      router_->ReleaseRoute(info_.id);
+      router_ = nullptr;
+    }
+  }
+
+  template <typename Weight>
+  EdgeId BaseRouter<Weight>::GetRouteEdge(RouteId route_id, size_t edge_idx) const {
+    std::lock_guard<std::mutex> lock(cache_mutex_);
+    return expanded_routes_cache_.at(route_id)[edge_idx];
+  }
+
+  template <typename Weight>
+  void BaseRouter<Weight>::ReleaseRoute(RouteId route_id) const {
+    std::lock_guard<std::mutex> lock(cache_mutex_);
+    expanded_routes_cache_.erase(route_id);
+  }
+
+  template <typename Weight>
+  typename BaseRouter<Weight>::RouteInfo BaseRouter<Weight>::SaveExpandedRoute(Weight weight,
+                                                                                std::vector<EdgeId> edges) const {
+    const size_t route_edge_count = edges.size();
+    std::lock_guard<std::mutex> lock(cache_mutex_);
+    const RouteId route_id = next_route_id_++;
+    expanded_routes_cache_[route_id] = std::move(edges);
+    return RouteInfo{route_id, weight, route_edge_count};
+  }
+
+}
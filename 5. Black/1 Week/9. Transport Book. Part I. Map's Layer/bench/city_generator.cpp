@@ -0,0 +1,268 @@
+//
+// Created by ilya on 04.06.2020.
+//
+
+#include "city_generator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <random>
+#include <sstream>
+
+#include "../coordinates.h"
+#include "../json_writer.h"
+
+namespace TransportDatabase {
+namespace {
+const double MIN_LATITUDE = 55.6;
+const double MIN_LONGITUDE = 37.4;
+const double LATITUDE_STEP = 0.005;
+const double LONGITUDE_STEP = 0.008;
+
+// Own distributions, so text does not depend on the standard library
+class Random {
+public:
+  explicit Random(uint32_t seed) : engine_(seed) {}
+
+  // In [0, 1)
+  double Uniform() {
+    return engine_() / 4294967296.0;
+  }
+  double Uniform(double min, double max) {
+    return min + (max - min) * Uniform();
+  }
+  size_t Index(size_t size) {
+    return static_cast<size_t>(Uniform() * size);
+  }
+
+private:
+  std::mt19937 engine_;
+};
+
+class CityGenerator {
+public:
+  explicit CityGenerator(const CityParams &params) : params_(params), random_(params.seed) {
+    side_ = std::max<size_t>(1, static_cast<size_t>(std::ceil(std::sqrt(params.stop_count))));
+  }
+
+  std::string Generate() {
+    PlaceStops();
+    MakeBuses();
+    std::ostringstream text;
+    {
+      Json::Writer out(text);
+      out.StartObject();
+      WriteSettings(out);
+      WriteBaseRequests(out);
+      WriteStatRequests(out);
+      out.EndObject();
+    }
+    return text.str();
+  }
+
+private:
+  static std::string StopName(size_t idx) {
+    return "Stop " + std::to_string(idx);
+  }
+  static std::string BusName(size_t idx) {
+    return "Bus " + std::to_string(idx);
+  }
+
+  void PlaceStops() {
+    for (size_t idx = 0; idx < params_.stop_count; ++idx) {
+      const double row = idx / side_ + random_.Uniform(-0.3, 0.3);
+      const double column = idx % side_ + random_.Uniform(-0.3, 0.3);
+      coords_.emplace_back(MIN_LATITUDE + row * LATITUDE_STEP, MIN_LONGITUDE + column * LONGITUDE_STEP);
+    }
+    distances_.resize(params_.stop_count);
+  }
+
+  size_t NextStop(size_t stop) {
+    std::vector<size_t> neighbours;
+    const size_t row = stop / side_;
+    const size_t column = stop % side_;
+    if (row > 0) neighbours.push_back(stop - side_);
+    if (stop + side_ < params_.stop_count) neighbours.push_back(stop + side_);
+    if (column > 0) neighbours.push_back(stop - 1);
+    if (column + 1 < side_ && stop + 1 < params_.stop_count) neighbours.push_back(stop + 1);
+    return neighbours.empty() ? stop : neighbours[random_.Index(neighbours.size())];
+  }
+
+  // Roads are longer than straight lines, one direction is enough
+  void AddRoad(size_t from, size_t to) {
+    if (from == to || distances_[from].count(to) || distances_[to].count(from)) {
+      return;
+    }
+    const double line = Coordinates::Distance(coords_[from], coords_[to]);
+    distances_[from][to] = std::max(1, static_cast<int>(line * random_.Uniform(1.1, 1.6)));
+  }
+
+  void MakeBuses() {
+    if (params_.stop_count == 0) {
+      return;
+    }
+    for (size_t bus = 0; bus < params_.bus_count; ++bus) {
+      const bool is_roundtrip = random_.Uniform() < params_.cycle_share;
+      const size_t length = std::max<size_t>(is_roundtrip ? 3 : 2, params_.route_length);
+      std::vector<size_t> stops = {random_.Index(params_.stop_count)};
+      while (stops.size() + (is_roundtrip ? 1 : 0) < length) {
+        stops.push_back(NextStop(stops.back()));
+      }
+      // Walk may come back to the first stop by itself
+      if (is_roundtrip && stops.back() != stops.front()) {
+        stops.push_back(stops.front());
+      }
+      for (size_t idx = 0; idx + 1 < stops.size(); ++idx) {
+        AddRoad(stops[idx], stops[idx + 1]);
+      }
+      buses_.push_back({is_roundtrip, std::move(stops)});
+    }
+  }
+
+  void WriteSettings(Json::Writer &out) const {
+    out.Key("serialization_settings").StartObject()
+        .Key("file").Value("transport_bench.bin")
+        .EndObject();
+    out.Key("routing_settings").StartObject()
+        .Key("bus_wait_time").Value(6)
+        .Key("bus_velocity").Value(40)
+        .Key("router").Value(params_.router)
+        .Key("route_graph").Value(params_.route_graph)
+        .Key("route_cache_size").Value(static_cast<int>(params_.route_cache_size))
+        .EndObject();
+    out.Key("render_settings").StartObject()
+        .Key("width").Value(1200)
+        .Key("height").Value(1200)
+        .Key("padding").Value(50)
+        .Key("stop_radius").Value(5)
+        .Key("line_width").Value(14)
+        .Key("stop_label_font_size").Value(20)
+        .Key("stop_label_offset").StartArray().Value(7).Value(-3).EndArray()
+        .Key("underlayer_color").StartArray().Value(255).Value(255).Value(255).Value(0.85).EndArray()
+        .Key("underlayer_width").Value(3)
+        .Key("color_palette").StartArray()
+        .Value("green").StartArray().Value(255).Value(160).Value(0).EndArray().Value("red")
+        .EndArray()
+        .Key("bus_label_font_size").Value(20)
+        .Key("bus_label_offset").StartArray().Value(7).Value(15).EndArray()
+        .Key("layers").StartArray()
+        .Value("bus_lines").Value("bus_labels").Value("stop_points").Value("stop_labels")
+        .EndArray()
+        .EndObject();
+  }
+
+  void WriteBaseRequests(Json::Writer &out) const {
+    out.Key("base_requests").StartArray();
+    for (size_t idx = 0; idx < params_.stop_count; ++idx) {
+      out.StartObject()
+          .Key("type").Value("Stop")
+          .Key("name").Value(StopName(idx))
+          .Key("latitude").Value(coords_[idx].GetLatitude())
+          .Key("longitude").Value(coords_[idx].GetLongitude())
+          .Key("road_distances").StartObject();
+      for (const auto &[to, distance] : distances_[idx]) {
+        out.Key(StopName(to)).Value(distance);
+      }
+      out.EndObject().EndObject();
+    }
+    for (size_t idx = 0; idx < buses_.size(); ++idx) {
+      out.StartObject()
+          .Key("type").Value("Bus")
+          .Key("name").Value(BusName(idx))
+          .Key("is_roundtrip").Value(buses_[idx].is_roundtrip)
+          .Key("stops").StartArray();
+      for (size_t stop : buses_[idx].stops) {
+        out.Value(StopName(stop));
+      }
+      out.EndArray().EndObject();
+    }
+    out.EndArray();
+  }
+
+  const std::string &PickType() {
+    double total = 0;
+    for (const auto &item : params_.stat_mix) {
+      total += item.second;
+    }
+    double point = random_.Uniform(0, total);
+    for (const auto &item : params_.stat_mix) {
+      if (point < item.second) {
+        return item.first;
+      }
+      point -= item.second;
+    }
+    return params_.stat_mix.back().first;
+  }
+
+  std::string RandomStop() {
+    return StopName(random_.Index(params_.stop_count));
+  }
+
+  Coordinates RandomPoint() {
+    return Coordinates(MIN_LATITUDE + random_.Uniform(0, side_) * LATITUDE_STEP,
+                       MIN_LONGITUDE + random_.Uniform(0, side_) * LONGITUDE_STEP);
+  }
+
+  void WriteStatRequests(Json::Writer &out) {
+    out.Key("stat_requests").StartArray();
+    if (params_.stop_count == 0 || params_.stat_mix.empty()) {
+      out.EndArray();
+      return;
+    }
+    for (size_t id = 0; id < params_.stat_count; ++id) {
+      const std::string &type = PickType();
+      out.StartObject().Key("id").Value(static_cast<int>(id)).Key("type").Value(type);
+      if (type == "Bus") {
+        out.Key("name").Value(BusName(random_.Index(std::max<size_t>(1, params_.bus_count))));
+      } else if (type == "Stop") {
+        out.Key("name").Value(RandomStop());
+      } else if (type == "Route") {
+        out.Key("from").Value(RandomStop()).Key("to").Value(RandomStop());
+      } else if (type == "RouteMatrix") {
+        for (const char *side : {"from", "to"}) {
+          out.Key(side).StartArray();
+          for (size_t idx = 0; idx < params_.matrix_size; ++idx) {
+            out.Value(RandomStop());
+          }
+          out.EndArray();
+        }
+      } else if (type == "NearestStops" || type == "StopsInRadius") {
+        const Coordinates center = RandomPoint();
+        out.Key("latitude").Value(center.GetLatitude()).Key("longitude").Value(center.GetLongitude());
+        if (type == "NearestStops") {
+          out.Key("count").Value(10);
+        } else {
+          out.Key("radius").Value(1000);
+        }
+      } else if (type == "StopsInBox") {
+        const Coordinates corner = RandomPoint();
+        out.Key("min_latitude").Value(corner.GetLatitude())
+            .Key("min_longitude").Value(corner.GetLongitude())
+            .Key("max_latitude").Value(corner.GetLatitude() + 3 * LATITUDE_STEP)
+            .Key("max_longitude").Value(corner.GetLongitude() + 3 * LONGITUDE_STEP);
+      }
+      out.EndObject();
+    }
+    out.EndArray();
+  }
+
+  struct Bus {
+    bool is_roundtrip;
+    std::vector<size_t> stops;
+  };
+
+  const CityParams &params_;
+  Random random_;
+  size_t side_;
+  std::vector<Coordinates> coords_;
+  // Sorted, so the same roads are written in the same order
+  std::vector<std::map<size_t, int>> distances_;
+  std::vector<Bus> buses_;
+};
+}
+
+std::string GenerateCity(const CityParams &params) {
+  return CityGenerator(params).Generate();
+}
+}
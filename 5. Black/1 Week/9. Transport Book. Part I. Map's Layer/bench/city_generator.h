@@ -0,0 +1,42 @@
+//
+// Created by ilya on 04.06.2020.
+//
+
+#ifndef YANDEXCPLUSPLUS_5_BLACK_1_WEEK_9_TRANSPORT_BOOK_PART_I_BENCH_CITY_GENERATOR_H
+#define YANDEXCPLUSPLUS_5_BLACK_1_WEEK_9_TRANSPORT_BOOK_PART_I_BENCH_CITY_GENERATOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace TransportDatabase {
+// Stops lie on a jittered grid, every bus walks between neighbour
+// cells, so buses cross each other as streets of a city do
+struct CityParams {
+  uint32_t seed = 1;
+  size_t stop_count = 1000;
+  size_t bus_count = 100;
+  // Stops of one bus as given in request, round trip ends with the first one
+  size_t route_length = 20;
+  // Part of buses which are round trips
+  double cycle_share = 0.5;
+  size_t stat_count = 1000;
+  // Weights of stat requests by their type
+  std::vector<std::pair<std::string, double>> stat_mix = {
+      {"Bus", 3}, {"Stop", 3}, {"Route", 3}, {"Map", 0}, {"RouteMatrix", 1},
+      {"NearestStops", 1}, {"StopsInRadius", 1}, {"StopsInBox", 1}};
+  // Stops on each side of RouteMatrix request
+  size_t matrix_size = 10;
+  std::string router = "all_pairs";
+  std::string route_graph = "stop_to_stop";
+  uint64_t route_cache_size = 4096;
+};
+
+// Whole input of DatabaseManager: settings, base and stat requests.
+// Same params and seed give the same text
+std::string GenerateCity(const CityParams &params);
+}
+
+#endif //YANDEXCPLUSPLUS_5_BLACK_1_WEEK_9_TRANSPORT_BOOK_PART_I_BENCH_CITY_GENERATOR_H
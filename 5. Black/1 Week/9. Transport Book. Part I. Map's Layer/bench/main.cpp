@@ -0,0 +1,211 @@
+//
+// Created by ilya on 04.06.2020.
+//
+// Times every stage of DatabaseManager on a synthetic city. Built from
+// the project sources without the project main.cpp, for example:
+//   g++ -std=c++17 -O2 -pthread -o transport_bench bench/*.cpp $(ls *.cpp | grep -v main.cpp)
+// Options are --name=value:
+//   --stops --buses --route_length --cycle_share --stat_requests --matrix_size
+//   --mix=Bus:3,Route:3,...  --router --route_graph --route_cache_size --seed
+//   --repeat  --format=csv|json  --emit (prints generated input instead of timings)
+#include "city_generator.h"
+#include "../manager.h"
+#include "../json_writer.h"
+
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+using namespace TransportDatabase;
+
+namespace {
+using Clock = std::chrono::steady_clock;
+
+struct Timing {
+  size_t count = 0;
+  Clock::duration total{};
+  Clock::duration max{};
+
+  void Add(Clock::duration duration) {
+    ++count;
+    total += duration;
+    max = std::max(max, duration);
+  }
+};
+
+struct Options {
+  CityParams city;
+  size_t repeat = 1;
+  std::string format = "csv";
+  bool emit = false;
+};
+
+std::vector<std::pair<std::string, double>> ParseMix(std::string_view text) {
+  std::vector<std::pair<std::string, double>> mix;
+  while (!text.empty()) {
+    const size_t comma = std::min(text.find(','), text.size());
+    const std::string_view item = text.substr(0, comma);
+    const size_t colon = item.find(':');
+    if (colon == std::string_view::npos) {
+      throw std::invalid_argument("mix item must be Type:weight");
+    }
+    mix.emplace_back(std::string(item.substr(0, colon)), std::stod(std::string(item.substr(colon + 1))));
+    text.remove_prefix(std::min(comma + 1, text.size()));
+  }
+  return mix;
+}
+
+Options ParseOptions(int argc, const char *argv[]) {
+  Options options;
+  CityParams &city = options.city;
+  for (int idx = 1; idx < argc; ++idx) {
+    const std::string_view arg = argv[idx];
+    const size_t eq = std::min(arg.find('='), arg.size());
+    const std::string_view name = arg.substr(0, eq);
+    const std::string value(arg.substr(std::min(eq + 1, arg.size())));
+    if (name == "--stops") city.stop_count = std::stoul(value);
+    else if (name == "--buses") city.bus_count = std::stoul(value);
+    else if (name == "--route_length") city.route_length = std::stoul(value);
+    else if (name == "--cycle_share") city.cycle_share = std::stod(value);
+    else if (name == "--stat_requests") city.stat_count = std::stoul(value);
+    else if (name == "--matrix_size") city.matrix_size = std::stoul(value);
+    else if (name == "--mix") city.stat_mix = ParseMix(value);
+    else if (name == "--router") city.router = value;
+    else if (name == "--route_graph") city.route_graph = value;
+    else if (name == "--route_cache_size") city.route_cache_size = std::stoull(value);
+    else if (name == "--seed") city.seed = std::stoul(value);
+    else if (name == "--repeat") options.repeat = std::stoul(value);
+    else if (name == "--format") options.format = value;
+    else if (name == "--emit") options.emit = true;
+    else throw std::invalid_argument("unknown option " + std::string(arg));
+  }
+  if (options.format != "csv" && options.format != "json") {
+    throw std::invalid_argument("format is csv or json");
+  }
+  return options;
+}
+
+template<typename Func>
+auto Measure(Timing &timing, Func func) {
+  const auto start = Clock::now();
+  auto result = func();
+  timing.Add(Clock::now() - start);
+  return result;
+}
+
+// Stages go one after another as in ProcessAllJSONRequests,
+// stat requests are answered one by one to time each of them
+void RunOnce(const std::string &input, std::map<std::string, Timing> &timings) {
+  std::istringstream in(input);
+  const Json::Document doc = Measure(timings["parse"], [&in] { return Json::Load(in); });
+  const auto &root = doc.GetRoot().AsMap();
+
+  auto db = std::make_shared<Database>();
+  DatabaseManager manager(db);
+  Measure(timings["database"], [&] {
+    for (const auto &request : root.at("base_requests").AsArray()) {
+      manager.ProcessJSONModifyRequest(request);
+    }
+    db->Freeze();
+    return true;
+  });
+
+  const RoutingParam routing = manager.ExtractRoutingParams(root.at("routing_settings"));
+  auto router = std::make_shared<Router>(db, routing);
+  const BuildStats build = router->GetBuildStats();
+  timings["graph"].Add(build.graph);
+  timings["router"].Add(build.router);
+
+  auto render = std::make_shared<Map>(db, manager.ExtractRenderParams(root.at("render_settings")));
+  Measure(timings["map_render"], [&render] {
+    render->CreateMap();
+    return render->RenderMap();
+  });
+
+  manager.ChangeRouter(router);
+  manager.ChangeMap(render);
+  for (const auto &request : root.at("stat_requests").AsArray()) {
+    const std::string &type = request.AsMap().at("type").AsString();
+    Measure(timings["stat:" + type], [&] { return manager.ProcessJSONReadRequest(request); });
+  }
+}
+
+double Milliseconds(Clock::duration duration) {
+  return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+double Microseconds(Clock::duration duration) {
+  return std::chrono::duration<double, std::micro>(duration).count();
+}
+
+void PrintCsv(const std::map<std::string, Timing> &timings, std::ostream &out) {
+  out << "name,count,total_ms,mean_us,max_us\n";
+  for (const auto &[name, timing] : timings) {
+    out << name << ',' << timing.count << ',' << Milliseconds(timing.total) << ','
+        << Microseconds(timing.total) / timing.count << ',' << Microseconds(timing.max) << '\n';
+  }
+}
+
+void PrintJson(const Options &options, const std::map<std::string, Timing> &timings, std::ostream &out) {
+  const CityParams &city = options.city;
+  Json::Writer writer(out);
+  writer.StartObject();
+  writer.Key("params").StartObject()
+      .Key("stops").Value(static_cast<int>(city.stop_count))
+      .Key("buses").Value(static_cast<int>(city.bus_count))
+      .Key("route_length").Value(static_cast<int>(city.route_length))
+      .Key("cycle_share").Value(city.cycle_share)
+      .Key("stat_requests").Value(static_cast<int>(city.stat_count))
+      .Key("router").Value(city.router)
+      .Key("route_graph").Value(city.route_graph)
+      .Key("seed").Value(static_cast<int>(city.seed))
+      .Key("repeat").Value(static_cast<int>(options.repeat));
+  writer.Key("mix").StartObject();
+  for (const auto &[type, weight] : city.stat_mix) {
+    writer.Key(type).Value(weight);
+  }
+  writer.EndObject().EndObject();
+  writer.Key("timings").StartArray();
+  for (const auto &[name, timing] : timings) {
+    writer.StartObject()
+        .Key("name").Value(name)
+        .Key("count").Value(static_cast<int>(timing.count))
+        .Key("total_ms").Value(Milliseconds(timing.total))
+        .Key("mean_us").Value(Microseconds(timing.total) / timing.count)
+        .Key("max_us").Value(Microseconds(timing.max))
+        .EndObject();
+  }
+  writer.EndArray().EndObject();
+  writer.Flush();
+  out << '\n';
+}
+}
+
+int main(int argc, const char *argv[]) {
+  Options options;
+  try {
+    options = ParseOptions(argc, argv);
+  } catch (const std::exception &e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+  const std::string input = GenerateCity(options.city);
+  if (options.emit) {
+    std::cout << input << std::endl;
+    return 0;
+  }
+  std::map<std::string, Timing> timings;
+  for (size_t run = 0; run < options.repeat; ++run) {
+    RunOnce(input, timings);
+  }
+  if (options.format == "json") {
+    PrintJson(options, timings, std::cout);
+  } else {
+    PrintCsv(timings, std::cout);
+  }
+  return 0;
+}
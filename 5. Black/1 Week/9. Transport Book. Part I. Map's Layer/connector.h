@@ -22,6 +22,9 @@ public:
     db_ = std::move(db);
   }
   virtual ~Connector() = default;
+  std::shared_ptr<const Database> TakeDatabase() const {
+    return db_;
+  }
 protected:
   std::shared_ptr<Database> db_;
 };
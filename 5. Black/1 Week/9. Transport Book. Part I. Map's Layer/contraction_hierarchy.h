@@ -0,0 +1,455 @@
+#pragma once
+
+#include "graph.h"
+#include "base_router.h"
+#include "dijkstra_router.h"
+#include "serialization.h"
+
+#include <algorithm>
+#include <cassert>
+#include <functional>
+#include <limits>
+#include <optional>
+#include <queue>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace Graph {
+
+  // Router over a contraction hierarchy. Vertices are contracted one by one
+  // in order of importance, and shortcut edges keep the distances between
+  // the remaining ones. A query is a bidirectional Dijkstra which goes only
+  // upwards the hierarchy, so it settles a small part of the graph.
+  // Shortcuts are unpacked back into the original edges of the graph.
+  template <typename Weight>
+  class ContractionHierarchyRouter : public BaseRouter<Weight> {
+  private:
+    using Graph = DirectedWeightedGraph<Weight>;
+
+  public:
+    ContractionHierarchyRouter(const Graph& graph);
+    // Restores hierarchy saved by Save without contracting the graph again
+    ContractionHierarchyRouter(const Graph& graph, Serialization::Reader& in);
+
+    void Save(std::ostream& out) const;
+
+    using typename BaseRouter<Weight>::RouteId;
+    using typename BaseRouter<Weight>::RouteInfo;
+
+    std::optional<Weight> BuildRouteEdges(VertexId from, VertexId to, std::vector<EdgeId>& edges) const override;
+    // Bucket many-to-many search: upward search from every target leaves
+    // its distances in buckets of settled vertices, then upward search
+    // from every source meets them there
+    std::vector<std::optional<Weight>> BuildWeightMatrix(const std::vector<VertexId>& sources,
+                                                         const std::vector<VertexId>& targets) const override;
+
+  private:
+    using SearchState = DijkstraSearchState<Weight>;
+    static constexpr EdgeId NO_EDGE = SearchState::NO_EDGE;
+    // Witness search gives up after this number of settled vertices,
+    // then the shortcut is added even if it may be redundant
+    static constexpr size_t WITNESS_SETTLE_LIMIT = 100;
+
+    // Edge of the hierarchy: either original edge of the graph
+    // or shortcut made of two other hierarchy edges
+    struct HierarchyEdge {
+      VertexId from;
+      VertexId to;
+      Weight weight;
+      EdgeId original = NO_EDGE;
+      size_t first_half = 0;
+      size_t second_half = 0;
+    };
+    using IncidenceList = std::vector<size_t>;
+
+    struct ContractionState {
+      std::vector<IncidenceList> outgoing;
+      std::vector<IncidenceList> incoming;
+      std::vector<char> contracted;
+      std::vector<int> contracted_neighbours;
+    };
+
+    void AddHierarchyEdge(ContractionState& state, const HierarchyEdge& edge);
+    // Best edge to every alive neighbour of vertex in one direction
+    std::vector<size_t> BestEdges(const ContractionState& state, VertexId vertex, bool outgoing) const;
+    // Returns number of shortcuts, adds them only if apply is set
+    int ContractVertex(ContractionState& state, VertexId vertex, bool apply);
+    int Priority(ContractionState& state, VertexId vertex);
+    void WitnessSearch(const ContractionState& state, VertexId from, VertexId excluded, Weight limit) const;
+
+    void Contract(const Graph& graph);
+    void BuildSearchGraphs();
+    // Appends original edges of hierarchy edge, last one first if reversed
+    void Unpack(size_t hierarchy_edge, std::vector<EdgeId>& edges, bool reversed = false) const;
+    // Settles every vertex reachable upwards the hierarchy,
+    // on_settle(vertex, weight) is called for each of them
+    template <typename Callback>
+    void UpwardSearch(VertexId from, bool is_forward, Callback on_settle) const;
+
+    std::vector<HierarchyEdge> edges_;
+    std::vector<size_t> rank_;
+    // Edges leading to a vertex of higher rank, by their start
+    std::vector<IncidenceList> upward_outgoing_;
+    // Edges coming from a vertex of higher rank, by their end
+    std::vector<IncidenceList> downward_incoming_;
+  };
+
+
+  template <typename Weight>
+  ContractionHierarchyRouter<Weight>::ContractionHierarchyRouter(const Graph& graph)
+      : rank_(graph.GetVertexCount()),
+        upward_outgoing_(graph.GetVertexCount()),
+        downward_incoming_(graph.GetVertexCount())
+  {
+    Contract(graph);
+    BuildSearchGraphs();
+  }
+
+  template <typename Weight>
+  ContractionHierarchyRouter<Weight>::ContractionHierarchyRouter(const Graph& graph, Serialization::Reader& in)
+      : upward_outgoing_(graph.GetVertexCount()),
+        downward_incoming_(graph.GetVertexCount())
+  {
+    Serialization::Deserialize(in, edges_);
+    Serialization::Deserialize(in, rank_);
+    if (rank_.size() != graph.GetVertexCount()) {
+      throw std::runtime_error("contraction hierarchy does not match graph");
+    }
+    BuildSearchGraphs();
+  }
+
+  template <typename Weight>
+  void ContractionHierarchyRouter<Weight>::Save(std::ostream& out) const {
+    Serialization::Serialize(edges_, out);
+    Serialization::Serialize(rank_, out);
+  }
+
+  template <typename Weight>
+  void ContractionHierarchyRouter<Weight>::BuildSearchGraphs() {
+    for (size_t edge_idx = 0; edge_idx < edges_.size(); ++edge_idx) {
+      const auto& edge = edges_[edge_idx];
+      if (rank_[edge.to] > rank_[edge.from]) {
+        upward_outgoing_[edge.from].push_back(edge_idx);
+      } else {
+        downward_incoming_[edge.to].push_back(edge_idx);
+      }
+    }
+  }
+
+  template <typename Weight>
+  void ContractionHierarchyRouter<Weight>::AddHierarchyEdge(ContractionState& state, const HierarchyEdge& edge) {
+    edges_.push_back(edge);
+    state.outgoing[edge.from].push_back(edges_.size() - 1);
+    state.incoming[edge.to].push_back(edges_.size() - 1);
+  }
+
+  template <typename Weight>
+  std::vector<size_t> ContractionHierarchyRouter<Weight>::BestEdges(const ContractionState& state,
+                                                                    VertexId vertex, bool outgoing) const {
+    std::vector<size_t> result;
+    const auto& incidence = outgoing ? state.outgoing[vertex] : state.incoming[vertex];
+    for (const size_t edge_idx : incidence) {
+      const auto& edge = edges_[edge_idx];
+      const VertexId neighbour = outgoing ? edge.to : edge.from;
+      if (state.contracted[neighbour] || neighbour == vertex) {
+        continue;
+      }
+      auto same = std::find_if(result.begin(), result.end(), [&](size_t other_idx) {
+        const auto& other = edges_[other_idx];
+        return (outgoing ? other.to : other.from) == neighbour;
+      });
+      if (same == result.end()) {
+        result.push_back(edge_idx);
+      } else if (edge.weight < edges_[*same].weight) {
+        *same = edge_idx;
+      }
+    }
+    return result;
+  }
+
+  template <typename Weight>
+  void ContractionHierarchyRouter<Weight>::WitnessSearch(const ContractionState& state, VertexId from,
+                                                         VertexId excluded, Weight limit) const {
+    using QueueItem = std::pair<Weight, VertexId>;
+    SearchState& search = SearchState::template ForThread<2>();
+    search.Prepare(state.outgoing.size());
+    search.Reset();
+
+    std::priority_queue<QueueItem, std::vector<QueueItem>, std::greater<>> queue;
+    search.Reach(from, 0, NO_EDGE);
+    queue.push({0, from});
+    size_t settled = 0;
+    while (!queue.empty() && settled < WITNESS_SETTLE_LIMIT) {
+      const auto [weight, vertex] = queue.top();
+      queue.pop();
+      if (weight > search.distance[vertex]) {
+        continue;
+      }
+      if (weight > limit) {
+        break;
+      }
+      ++settled;
+      for (const size_t edge_idx : state.outgoing[vertex]) {
+        const auto& edge = edges_[edge_idx];
+        if (edge.to == excluded || state.contracted[edge.to]) {
+          continue;
+        }
+        const Weight candidate_weight = weight + edge.weight;
+        if (!search.reached[edge.to] || candidate_weight < search.distance[edge.to]) {
+          search.Reach(edge.to, candidate_weight, edge_idx);
+          queue.push({candidate_weight, edge.to});
+        }
+      }
+    }
+  }
+
+  template <typename Weight>
+  int ContractionHierarchyRouter<Weight>::ContractVertex(ContractionState& state, VertexId vertex, bool apply) {
+    const auto incoming = BestEdges(state, vertex, false);
+    const auto outgoing = BestEdges(state, vertex, true);
+    if (incoming.empty() || outgoing.empty()) {
+      return 0;
+    }
+    Weight max_outgoing = 0;
+    for (const size_t out_idx : outgoing) {
+      max_outgoing = std::max(max_outgoing, edges_[out_idx].weight);
+    }
+
+    std::vector<HierarchyEdge> shortcuts;
+    for (const size_t in_idx : incoming) {
+      const VertexId from = edges_[in_idx].from;
+      WitnessSearch(state, from, vertex, edges_[in_idx].weight + max_outgoing);
+      const SearchState& search = SearchState::template ForThread<2>();
+      for (const size_t out_idx : outgoing) {
+        const VertexId to = edges_[out_idx].to;
+        if (to == from) {
+          continue;
+        }
+        const Weight shortcut_weight = edges_[in_idx].weight + edges_[out_idx].weight;
+        if (search.reached[to] && search.distance[to] <= shortcut_weight) {
+          continue;
+        }
+        shortcuts.push_back({from, to, shortcut_weight, NO_EDGE, in_idx, out_idx});
+      }
+    }
+    if (apply) {
+      for (const auto& shortcut : shortcuts) {
+        AddHierarchyEdge(state, shortcut);
+      }
+    }
+    return static_cast<int>(shortcuts.size());
+  }
+
+  template <typename Weight>
+  int ContractionHierarchyRouter<Weight>::Priority(ContractionState& state, VertexId vertex) {
+    const int removed_edges = static_cast<int>(BestEdges(state, vertex, false).size()
+        + BestEdges(state, vertex, true).size());
+    return ContractVertex(state, vertex, false) - removed_edges + state.contracted_neighbours[vertex];
+  }
+
+  template <typename Weight>
+  void ContractionHierarchyRouter<Weight>::Contract(const Graph& graph) {
+    const size_t vertex_count = graph.GetVertexCount();
+    ContractionState state{std::vector<IncidenceList>(vertex_count),
+                           std::vector<IncidenceList>(vertex_count),
+                           std::vector<char>(vertex_count, false),
+                           std::vector<int>(vertex_count, 0)};
+    for (EdgeId edge_id = 0; edge_id < graph.GetEdgeCount(); ++edge_id) {
+      const auto& edge = graph.GetEdge(edge_id);
+      assert(edge.weight >= 0);
+      if (edge.from != edge.to) {
+        AddHierarchyEdge(state, {edge.from, edge.to, edge.weight, edge_id});
+      }
+    }
+
+    // Priorities are updated lazily: a vertex is contracted only if its
+    // recomputed priority is still not worse than the next one in the queue
+    using QueueItem = std::pair<int, VertexId>;
+    std::priority_queue<QueueItem, std::vector<QueueItem>, std::greater<>> queue;
+    for (VertexId vertex = 0; vertex < vertex_count; ++vertex) {
+      queue.push({Priority(state, vertex), vertex});
+    }
+    size_t next_rank = 0;
+    while (!queue.empty()) {
+      const VertexId vertex = queue.top().second;
+      queue.pop();
+      const int priority = Priority(state, vertex);
+      if (!queue.empty() && priority > queue.top().first) {
+        queue.push({priority, vertex});
+        continue;
+      }
+      ContractVertex(state, vertex, true);
+      state.contracted[vertex] = true;
+      rank_[vertex] = next_rank++;
+      for (const size_t edge_idx : state.outgoing[vertex]) {
+        ++state.contracted_neighbours[edges_[edge_idx].to];
+      }
+      for (const size_t edge_idx : state.incoming[vertex]) {
+        ++state.contracted_neighbours[edges_[edge_idx].from];
+      }
+    }
+  }
+
+  template <typename Weight>
+  void ContractionHierarchyRouter<Weight>::Unpack(size_t hierarchy_edge, std::vector<EdgeId>& edges,
+                                                  bool reversed) const {
+    // Keeps its capacity between calls
+    static thread_local std::vector<size_t> stack;
+    stack.assign(1, hierarchy_edge);
+    while (!stack.empty()) {
+      const auto& edge = edges_[stack.back()];
+      stack.pop_back();
+      if (edge.original != NO_EDGE) {
+        edges.push_back(edge.original);
+      } else {
+        stack.push_back(reversed ? edge.first_half : edge.second_half);
+        stack.push_back(reversed ? edge.second_half : edge.first_half);
+      }
+    }
+  }
+
+  template <typename Weight>
+  std::optional<Weight> ContractionHierarchyRouter<Weight>::BuildRouteEdges(VertexId from, VertexId to,
+                                                                            std::vector<EdgeId>& edges) const {
+    using QueueItem = std::pair<Weight, VertexId>;
+    using Queue = std::priority_queue<QueueItem, std::vector<QueueItem>, std::greater<>>;
+    SearchState& forward = SearchState::template ForThread<0>();
+    SearchState& backward = SearchState::template ForThread<1>();
+    forward.Prepare(rank_.size());
+    backward.Prepare(rank_.size());
+
+    std::optional<Weight> best_weight;
+    VertexId meeting_vertex = from;
+    auto reach = [&](SearchState& state, const SearchState& other, Queue& queue,
+                     VertexId vertex, Weight weight, size_t edge_idx) {
+      state.Reach(vertex, weight, edge_idx);
+      queue.push({weight, vertex});
+      if (other.reached[vertex]) {
+        const Weight candidate_weight = weight + other.distance[vertex];
+        if (!best_weight || candidate_weight < *best_weight) {
+          best_weight = candidate_weight;
+          meeting_vertex = vertex;
+        }
+      }
+    };
+
+    Queue forward_queue;
+    Queue backward_queue;
+    reach(forward, backward, forward_queue, from, 0, NO_EDGE);
+    reach(backward, forward, backward_queue, to, 0, NO_EDGE);
+    // Settles one vertex of the direction, drops the direction
+    // when it can not improve the best route anymore
+    auto step = [&](SearchState& state, const SearchState& other, Queue& queue, bool is_forward) {
+      while (!queue.empty()) {
+        const auto [weight, vertex] = queue.top();
+        queue.pop();
+        if (weight > state.distance[vertex]) {
+          continue;
+        }
+        if (best_weight && weight >= *best_weight) {
+          queue = Queue();
+          return;
+        }
+        const auto& incidence = is_forward ? upward_outgoing_[vertex] : downward_incoming_[vertex];
+        for (const size_t edge_idx : incidence) {
+          const auto& edge = edges_[edge_idx];
+          const VertexId next = is_forward ? edge.to : edge.from;
+          const Weight candidate_weight = weight + edge.weight;
+          if (!state.reached[next] || candidate_weight < state.distance[next]) {
+            reach(state, other, queue, next, candidate_weight, edge_idx);
+          }
+        }
+        return;
+      }
+    };
+    while (!forward_queue.empty() || !backward_queue.empty()) {
+      step(forward, backward, forward_queue, true);
+      step(backward, forward, backward_queue, false);
+    }
+
+    // Forward half is walked from the meeting vertex back, so it is
+    // unpacked reversed and turned around
+    edges.clear();
+    if (best_weight) {
+      for (size_t edge_idx = forward.prev_edge[meeting_vertex]; edge_idx != NO_EDGE;
+           edge_idx = forward.prev_edge[edges_[edge_idx].from]) {
+        Unpack(edge_idx, edges, true);
+      }
+      std::reverse(edges.begin(), edges.end());
+      for (size_t edge_idx = backward.prev_edge[meeting_vertex]; edge_idx != NO_EDGE;
+           edge_idx = backward.prev_edge[edges_[edge_idx].to]) {
+        Unpack(edge_idx, edges);
+      }
+    }
+    forward.Reset();
+    backward.Reset();
+    return best_weight;
+  }
+
+  template <typename Weight>
+  template <typename Callback>
+  void ContractionHierarchyRouter<Weight>::UpwardSearch(VertexId from, bool is_forward, Callback on_settle) const {
+    using QueueItem = std::pair<Weight, VertexId>;
+    SearchState& state = SearchState::template ForThread<0>();
+    state.Prepare(rank_.size());
+    std::priority_queue<QueueItem, std::vector<QueueItem>, std::greater<>> queue;
+    state.Reach(from, 0, NO_EDGE);
+    queue.push({0, from});
+    while (!queue.empty()) {
+      const auto [weight, vertex] = queue.top();
+      queue.pop();
+      if (weight > state.distance[vertex]) {
+        continue;
+      }
+      on_settle(vertex, weight);
+      const auto& incidence = is_forward ? upward_outgoing_[vertex] : downward_incoming_[vertex];
+      for (const size_t edge_idx : incidence) {
+        const auto& edge = edges_[edge_idx];
+        const VertexId next = is_forward ? edge.to : edge.from;
+        const Weight candidate_weight = weight + edge.weight;
+        if (!state.reached[next] || candidate_weight < state.distance[next]) {
+          state.Reach(next, candidate_weight, edge_idx);
+          queue.push({candidate_weight, next});
+        }
+      }
+    }
+    state.Reset();
+  }
+
+  template <typename Weight>
+  std::vector<std::optional<Weight>>
+  ContractionHierarchyRouter<Weight>::BuildWeightMatrix(const std::vector<VertexId>& sources,
+                                                        const std::vector<VertexId>& targets) const {
+    struct BucketEntry {
+      size_t target_idx;
+      Weight weight;
+    };
+    std::unordered_map<VertexId, std::vector<BucketEntry>> buckets;
+    for (size_t target_idx = 0; target_idx < targets.size(); ++target_idx) {
+      UpwardSearch(targets[target_idx], false, [&buckets, target_idx](VertexId vertex, Weight weight) {
+        buckets[vertex].push_back({target_idx, weight});
+      });
+    }
+
+    std::vector<std::optional<Weight>> weights(sources.size() * targets.size());
+    for (size_t source_idx = 0; source_idx < sources.size(); ++source_idx) {
+      auto row = weights.begin() + source_idx * targets.size();
+      UpwardSearch(sources[source_idx], true, [&buckets, row](VertexId vertex, Weight weight) {
+        auto it = buckets.find(vertex);
+        if (it == buckets.end()) {
+          return;
+        }
+        for (const auto& entry : it->second) {
+          auto& best = row[entry.target_idx];
+          if (!best || weight + entry.weight < *best) {
+            best = weight + entry.weight;
+          }
+        }
+      });
+    }
+    return weights;
+  }
+
+}
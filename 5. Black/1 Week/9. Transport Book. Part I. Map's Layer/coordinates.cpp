@@ -5,6 +5,10 @@
 #include <cmath>
 #include "coordinates.h"
 
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
 namespace TransportDatabase {
 double Coordinates::GetLatitude() const {
   return latitude_;
@@ -51,6 +55,160 @@ bool Coordinates::operator==(const Coordinates &other) const {
   return (latitude_ == other.latitude_) && (longitude_ == other.longitude_);
 }
 
+namespace {
+// Operations of the distance kernel on one double at a time
+struct ScalarOps {
+  using Vec = double;
+  using Mask = bool;
+  static constexpr size_t WIDTH = 1;
+
+  static Vec Set(double value) { return value; }
+  static Vec Gather(const double *base, const uint32_t *idx) { return base[*idx]; }
+  static void Store(double *out, Vec value) { *out = value; }
+  static Vec Add(Vec lhs, Vec rhs) { return lhs + rhs; }
+  static Vec Sub(Vec lhs, Vec rhs) { return lhs - rhs; }
+  static Vec Mul(Vec lhs, Vec rhs) { return lhs * rhs; }
+  static Vec Div(Vec lhs, Vec rhs) { return lhs / rhs; }
+  static Vec Sqrt(Vec value) { return std::sqrt(value); }
+  static Vec Abs(Vec value) { return std::abs(value); }
+  static Vec CopySign(Vec value, Vec sign) { return std::copysign(value, sign); }
+  static Mask Greater(Vec lhs, Vec rhs) { return lhs > rhs; }
+  static Vec Select(Mask mask, Vec if_true, Vec if_false) { return mask ? if_true : if_false; }
+};
+
+#if defined(__AVX2__)
+struct SimdOps {
+  using Vec = __m256d;
+  using Mask = __m256d;
+  static constexpr size_t WIDTH = 4;
+
+  static Vec Set(double value) { return _mm256_set1_pd(value); }
+  static Vec Gather(const double *base, const uint32_t *idx) {
+    return _mm256_i32gather_pd(base, _mm_loadu_si128(reinterpret_cast<const __m128i *>(idx)), 8);
+  }
+  static void Store(double *out, Vec value) { _mm256_storeu_pd(out, value); }
+  static Vec Add(Vec lhs, Vec rhs) { return _mm256_add_pd(lhs, rhs); }
+  static Vec Sub(Vec lhs, Vec rhs) { return _mm256_sub_pd(lhs, rhs); }
+  static Vec Mul(Vec lhs, Vec rhs) { return _mm256_mul_pd(lhs, rhs); }
+  static Vec Div(Vec lhs, Vec rhs) { return _mm256_div_pd(lhs, rhs); }
+  static Vec Sqrt(Vec value) { return _mm256_sqrt_pd(value); }
+  static Vec Abs(Vec value) { return _mm256_andnot_pd(_mm256_set1_pd(-0.0), value); }
+  static Vec CopySign(Vec value, Vec sign) {
+    const Vec sign_bit = _mm256_set1_pd(-0.0);
+    return _mm256_or_pd(_mm256_andnot_pd(sign_bit, value), _mm256_and_pd(sign_bit, sign));
+  }
+  static Mask Greater(Vec lhs, Vec rhs) { return _mm256_cmp_pd(lhs, rhs, _CMP_GT_OQ); }
+  static Vec Select(Mask mask, Vec if_true, Vec if_false) { return _mm256_blendv_pd(if_false, if_true, mask); }
+};
+#elif defined(__SSE2__)
+struct SimdOps {
+  using Vec = __m128d;
+  using Mask = __m128d;
+  static constexpr size_t WIDTH = 2;
+
+  static Vec Set(double value) { return _mm_set1_pd(value); }
+  static Vec Gather(const double *base, const uint32_t *idx) { return _mm_set_pd(base[idx[1]], base[idx[0]]); }
+  static void Store(double *out, Vec value) { _mm_storeu_pd(out, value); }
+  static Vec Add(Vec lhs, Vec rhs) { return _mm_add_pd(lhs, rhs); }
+  static Vec Sub(Vec lhs, Vec rhs) { return _mm_sub_pd(lhs, rhs); }
+  static Vec Mul(Vec lhs, Vec rhs) { return _mm_mul_pd(lhs, rhs); }
+  static Vec Div(Vec lhs, Vec rhs) { return _mm_div_pd(lhs, rhs); }
+  static Vec Sqrt(Vec value) { return _mm_sqrt_pd(value); }
+  static Vec Abs(Vec value) { return _mm_andnot_pd(_mm_set1_pd(-0.0), value); }
+  static Vec CopySign(Vec value, Vec sign) {
+    const Vec sign_bit = _mm_set1_pd(-0.0);
+    return _mm_or_pd(_mm_andnot_pd(sign_bit, value), _mm_and_pd(sign_bit, sign));
+  }
+  static Mask Greater(Vec lhs, Vec rhs) { return _mm_cmpgt_pd(lhs, rhs); }
+  static Vec Select(Mask mask, Vec if_true, Vec if_false) {
+    return _mm_or_pd(_mm_and_pd(mask, if_true), _mm_andnot_pd(mask, if_false));
+  }
+};
+#else
+using SimdOps = ScalarOps;
+#endif
+
+// Arctangent with reduction to |x| <= 0.66 and rational approximation
+// there as in Cephes, error is a few ulps on the whole line
+template<typename Ops>
+typename Ops::Vec Atan(typename Ops::Vec x) {
+  using Vec = typename Ops::Vec;
+  const Vec abs_x = Ops::Abs(x);
+  const typename Ops::Mask big = Ops::Greater(abs_x, Ops::Set(2.41421356237309504880));
+  const typename Ops::Mask medium = Ops::Greater(abs_x, Ops::Set(0.66));
+  const Vec one = Ops::Set(1.0);
+
+  Vec reduced = Ops::Select(medium, Ops::Div(Ops::Sub(abs_x, one), Ops::Add(abs_x, one)), abs_x);
+  reduced = Ops::Select(big, Ops::Div(Ops::Set(-1.0), abs_x), reduced);
+  // Lost low bits of pi / 4 and pi / 2 are added to the small part
+  Vec offset = Ops::Select(medium, Ops::Set(7.85398163397448309616E-1), Ops::Set(0.0));
+  offset = Ops::Select(big, Ops::Set(1.57079632679489661923), offset);
+  Vec more_bits = Ops::Select(medium, Ops::Set(0.5 * 6.123233995736765886130E-17), Ops::Set(0.0));
+  more_bits = Ops::Select(big, Ops::Set(6.123233995736765886130E-17), more_bits);
+
+  const Vec z = Ops::Mul(reduced, reduced);
+  Vec p = Ops::Set(-8.750608600031904122785E-1);
+  p = Ops::Add(Ops::Mul(p, z), Ops::Set(-1.615753718733365076637E1));
+  p = Ops::Add(Ops::Mul(p, z), Ops::Set(-7.500855792314704667340E1));
+  p = Ops::Add(Ops::Mul(p, z), Ops::Set(-1.228866684490136173410E2));
+  p = Ops::Add(Ops::Mul(p, z), Ops::Set(-6.485021904942025371773E1));
+  Vec q = Ops::Add(z, Ops::Set(2.485846490142306297962E1));
+  q = Ops::Add(Ops::Mul(q, z), Ops::Set(1.650270098316988542046E2));
+  q = Ops::Add(Ops::Mul(q, z), Ops::Set(4.328810604912902668951E2));
+  q = Ops::Add(Ops::Mul(q, z), Ops::Set(4.853903996359136964868E2));
+  q = Ops::Add(Ops::Mul(q, z), Ops::Set(1.945506571482613964425E2));
+  const Vec tail = Ops::Mul(z, Ops::Div(p, q));
+  const Vec result = Ops::Add(offset, Ops::Add(Ops::Add(reduced, Ops::Mul(reduced, tail)), more_bits));
+  return Ops::CopySign(result, x);
+}
+
+// Handles pairs from begin while whole vectors fit, returns where it stopped
+template<typename Ops>
+size_t DistancesKernel(const double *xs, const double *ys, const double *zs,
+                       const uint32_t *from, const uint32_t *to,
+                       size_t begin, size_t count, double meters_per_radian, double *distances) {
+  using Vec = typename Ops::Vec;
+  size_t idx = begin;
+  for (; idx + Ops::WIDTH <= count; idx += Ops::WIDTH) {
+    const Vec ax = Ops::Gather(xs, from + idx), ay = Ops::Gather(ys, from + idx), az = Ops::Gather(zs, from + idx);
+    const Vec bx = Ops::Gather(xs, to + idx), by = Ops::Gather(ys, to + idx), bz = Ops::Gather(zs, to + idx);
+    const Vec cx = Ops::Sub(Ops::Mul(ay, bz), Ops::Mul(az, by));
+    const Vec cy = Ops::Sub(Ops::Mul(az, bx), Ops::Mul(ax, bz));
+    const Vec cz = Ops::Sub(Ops::Mul(ax, by), Ops::Mul(ay, bx));
+    const Vec cross = Ops::Sqrt(Ops::Add(Ops::Add(Ops::Mul(cx, cx), Ops::Mul(cy, cy)), Ops::Mul(cz, cz)));
+    const Vec dot = Ops::Add(Ops::Add(Ops::Mul(ax, bx), Ops::Mul(ay, by)), Ops::Mul(az, bz));
+    Ops::Store(distances + idx, Ops::Mul(Atan<Ops>(Ops::Div(cross, dot)), Ops::Set(meters_per_radian)));
+  }
+  return idx;
+}
+}
+
+size_t CoordinatesTable::Size() const {
+  return x_.size();
+}
+
+void CoordinatesTable::Resize(size_t size) {
+  x_.resize(size, 1.0);
+  y_.resize(size, 0.0);
+  z_.resize(size, 0.0);
+}
+
+void CoordinatesTable::Set(size_t idx, const Coordinates &coord) {
+  const double lat = coord.latitude_ * Coordinates::PI / 180.0;
+  const double lon = coord.longitude_ * Coordinates::PI / 180.0;
+  x_[idx] = std::cos(lat) * std::cos(lon);
+  y_[idx] = std::cos(lat) * std::sin(lon);
+  z_[idx] = std::sin(lat);
+}
+
+void CoordinatesTable::Distances(const uint32_t *from, const uint32_t *to, size_t count, double *distances) const {
+  const double meters_per_radian = Coordinates::RADIUS * 1000.0;
+  size_t done = DistancesKernel<SimdOps>(x_.data(), y_.data(), z_.data(), from, to,
+                                         0, count, meters_per_radian, distances);
+  DistancesKernel<ScalarOps>(x_.data(), y_.data(), z_.data(), from, to,
+                             done, count, meters_per_radian, distances);
+}
+
 CoordinatesBuilder &CoordinatesBuilder::SetLatitude(double lat) {
   latitude_ = lat;
   return *this;
@@ -5,6 +5,10 @@
 #ifndef YANDEXCPLUSPLUS_4_BROWN_FINAL_PROJECT_PART_A_COORDINATES_H
 #define YANDEXCPLUSPLUS_4_BROWN_FINAL_PROJECT_PART_A_COORDINATES_H
 
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
 namespace TransportDatabase {
 class Coordinates {
 public:
@@ -21,12 +25,39 @@ public:
   bool operator==(const Coordinates& other) const;
 
 private:
+  friend class CoordinatesTable;
+
   constexpr static double PI = 3.1415926535;
   constexpr static int RADIUS = 6371;
   double latitude_ = 0;
   double longitude_ = 0;
 };
 
+// Points on the unit sphere kept by index. Distance between two points
+// is atan(|a x b| / (a, b)), the same angle as in Coordinates::Distance,
+// but without trigonometry of latitudes and longitudes per pair.
+// Batches are computed with AVX2 or SSE2 when the build enables them,
+// the rest with the same scalar code
+class CoordinatesTable {
+public:
+  // Relative difference from Coordinates::Distance for points closer
+  // than quarter of the Earth circle
+  static constexpr double TOLERANCE = 1e-9;
+
+  size_t Size() const;
+  // New points are at zero coordinates as default Coordinates
+  void Resize(size_t size);
+  void Set(size_t idx, const Coordinates &coord);
+
+  // distances[i] is distance between points from[i] and to[i] in meters
+  void Distances(const uint32_t *from, const uint32_t *to, size_t count, double *distances) const;
+
+private:
+  std::vector<double> x_;
+  std::vector<double> y_;
+  std::vector<double> z_;
+};
+
 class CoordinatesBuilder {
 public:
   CoordinatesBuilder() = default;
@@ -4,56 +4,34 @@
 
 #include "database.h"
 
+#include <algorithm>
+#include <stdexcept>
+#include <tuple>
 #include <utility>
 
 namespace TransportDatabase {
-Stop::Stop() {
-  name_ = "unnamed";
-}
-Stop::Stop(std::string name, const Coordinates &coord) : name_(std::move(name)), coord_(coord) {}
-
-Stop::Stop(std::string name, const Coordinates &coord, const std::vector<std::pair<std::string, int>> &distances)
-    : name_(std::move(name)), coord_(coord) {
-  for (const auto&[key, value] : distances) {
-    distance_to_stop[key] = value;
+namespace {
+// Great circle distances between neighbour stops in one batch
+double PathLength(const CoordinatesTable &points, const std::vector<StopId> &stops) {
+  if (stops.size() < 2) {
+    return 0;
   }
-}
-
-Stop::Stop(const Stop &other) {
-  name_ = other.name_;
-  coord_ = other.coord_;
-  for (const auto&[stop_name, distance] : other.distance_to_stop) {
-    distance_to_stop[stop_name] = distance;
-  }
-}
-
-Stop::Stop(Stop &&other) noexcept {
-  name_ = std::move(other.name_);
-  coord_ = other.coord_;
-  for (auto&[stop_name, distance] : other.distance_to_stop) {
-    distance_to_stop[std::move(stop_name)] = std::move(distance);
+  std::vector<double> distances(stops.size() - 1);
+  points.Distances(stops.data(), stops.data() + 1, distances.size(), distances.data());
+  double result = 0;
+  for (double distance : distances) {
+    result += distance;
   }
+  return result;
 }
-
-Stop &Stop::operator=(const Stop &other) {
-  name_ = other.name_;
-  coord_ = other.coord_;
-  for (const auto&[stop_name, distance] : other.distance_to_stop) {
-    distance_to_stop[stop_name] = distance;
-  }
-  return *this;
 }
 
-Stop &Stop::operator=(Stop &&other) noexcept {
-  name_ = std::move(other.name_);
-  coord_ = other.coord_;
-  for (auto&[stop_name, distance] : other.distance_to_stop) {
-    distance_to_stop[std::move(stop_name)] = std::move(distance);
-  }
-  return *this;
+Stop::Stop() {
+  name_ = "unnamed";
 }
+Stop::Stop(std::string name, const Coordinates &coord) : name_(std::move(name)), coord_(coord) {}
 
-std::string Stop::GetName() const {
+const std::string &Stop::GetName() const {
   return name_;
 }
 
@@ -61,6 +39,10 @@ Coordinates Stop::GetCoord() const {
   return coord_;
 }
 
+StopId Stop::GetId() const {
+  return id_;
+}
+
 void Stop::AddRoute(const std::string &route_name) {
   routes_for_stop.insert(route_name);
 }
@@ -77,16 +59,36 @@ bool Stop::operator!=(const Stop &other) const {
   return !(*this == other);
 }
 
+Route::Route(const Database &db, const std::string &name, std::vector<StopId> stops, RouteTypes type)
+    : route_type(type), db_(db), name_(name), stops_(std::move(stops)) {
+  std::vector<StopId> unique_stops = stops_;
+  std::sort(unique_stops.begin(), unique_stops.end());
+  unique_stops_count_ = std::unique(unique_stops.begin(), unique_stops.end()) - unique_stops.begin();
+}
+
 double Route::Curvature() const {
   return RealLength() / Length();
 }
 
-std::string Route::GetName() const {
+const std::string &Route::GetName() const {
   return name_;
 }
 
+BusId Route::GetId() const {
+  return id_;
+}
+
+const std::vector<StopId> &Route::GetStops() const {
+  return stops_;
+}
+
 std::vector<std::string> Route::GetStopsName() const {
-  return stops_name_;
+  std::vector<std::string> result;
+  result.reserve(stops_.size());
+  for (const auto stop_id : stops_) {
+    result.push_back(db_.TakeStop(stop_id)->GetName());
+  }
+  return result;
 }
 
 size_t LinearRoute::CountOfStops() const {
@@ -94,25 +96,20 @@ size_t LinearRoute::CountOfStops() const {
 }
 
 size_t LinearRoute::CountOfUniqueStops() const {
-  return unique_stops_.size();
+  return unique_stops_count_;
 }
 
 double LinearRoute::RealLength() const {
   double result = 0;
-  for (size_t i = 0; i < stops_.size() - 1; ++i) {
-    result += stops_[i]->distance_to_stop.at(stops_[i + 1]->GetName()) +
-        stops_[i + 1]->distance_to_stop.at(stops_[i]->GetName());
+  for (size_t i = 0; i + 1 < stops_.size(); ++i) {
+    result += db_.Distance(stops_[i], stops_[i + 1]) + db_.Distance(stops_[i + 1], stops_[i]);
   }
   return result;
 }
 
 double LinearRoute::Length() const {
-  double result = 0;
-  for (size_t i = 0; i < stops_.size() - 1; ++i) {
-    result += Coordinates::Distance(stops_[i]->GetCoord(), stops_[i + 1]->GetCoord())
-        + Coordinates::Distance(stops_[i + 1]->GetCoord(), stops_[i]->GetCoord());
-  }
-  return result;
+  // Way back is the same distance
+  return 2 * PathLength(db_.TakeStopPoints(), stops_);
 }
 
 size_t CycleRoute::CountOfStops() const {
@@ -120,35 +117,33 @@ size_t CycleRoute::CountOfStops() const {
 }
 
 size_t CycleRoute::CountOfUniqueStops() const {
-  return unique_stops_.size();
+  return unique_stops_count_;
 }
 
 double CycleRoute::RealLength() const {
   double result = 0;
-  for (size_t i = 0; i < stops_.size() - 1; ++i) {
-    result += stops_[i]->distance_to_stop.at(stops_[i + 1]->GetName());
+  for (size_t i = 0; i + 1 < stops_.size(); ++i) {
+    result += db_.Distance(stops_[i], stops_[i + 1]);
   }
   return result;
 }
 
 double CycleRoute::Length() const {
-  double result = 0;
-  for (size_t i = 0; i < stops_.size() - 1; ++i) {
-    result += Coordinates::Distance(stops_[i]->GetCoord(), stops_[i + 1]->GetCoord());
-  }
-  return result;
+  return PathLength(db_.TakeStopPoints(), stops_);
 }
 
-void Database::AddStop(const Stop &stop) {
-  auto inserted = stops_.try_emplace(stop.GetName(), std::make_shared<Stop>(stop));
-  if (!inserted.second) {
-    *(inserted.first->second) = stop;
+void Database::AddStop(const Stop &stop, const std::vector<std::pair<std::string, int>> &distances) {
+  const StopId id = InternStop(stop.GetName());
+  stops_[id]->coord_ = stop.GetCoord();
+  stop_points_.Set(id, stop.GetCoord());
+  ++version_;
+  if (!stops_[id]->routes_for_stop.empty()) {
+    rewrite_version_ = version_;
   }
-  for (const auto&[stop_name, distance] : stop.distance_to_stop) {
-    auto curr_stop = TakeOrAddStop(stop_name);
-    if (!curr_stop->distance_to_stop.count(stop.GetName())) {
-      curr_stop->distance_to_stop[stop.GetName()] = distance;
-    }
+  for (const auto&[stop_name, distance] : distances) {
+    const StopId other_id = InternStop(stop_name);
+    SetDistance(id, other_id, distance, true);
+    SetDistance(other_id, id, distance, false);
   }
   stat.min_lat = std::min(stat.min_lat, stop.GetCoord().GetLatitude());
   stat.max_lat = std::max(stat.max_lat, stop.GetCoord().GetLatitude());
@@ -156,61 +151,208 @@ void Database::AddStop(const Stop &stop) {
   stat.max_long = std::max(stat.max_long, stop.GetCoord().GetLongitude());
 }
 
-std::shared_ptr<Stop> Database::TakeOrAddStop(const std::string &stop_name) {
-  if (!stops_.count(stop_name)) {
-    auto inserted = stops_.insert({stop_name, std::make_shared<Stop>(stop_name, Coordinates())});
+StopId Database::InternStop(const std::string &stop_name) {
+  auto inserted = stop_ids_.try_emplace(stop_name, static_cast<StopId>(stops_.size()));
+  if (inserted.second) {
+    auto stop = std::make_shared<Stop>(stop_name, Coordinates());
+    stop->id_ = inserted.first->second;
+    stops_.push_back(std::move(stop));
+    stop_points_.Resize(stops_.size());
+    added_distances_.emplace_back();
+    frozen_ = false;
+    ++version_;
+  }
+  return inserted.first->second;
+}
+
+std::optional<StopId> Database::FindStop(const std::string &stop_name) const {
+  auto it = stop_ids_.find(stop_name);
+  if (it == stop_ids_.end()) {
+    return std::nullopt;
   }
-  return stops_.at(stop_name);
+  return it->second;
+}
+
+std::shared_ptr<Stop> Database::TakeOrAddStop(const std::string &stop_name) {
+  return stops_[InternStop(stop_name)];
 }
 
 std::shared_ptr<Stop> Database::TakeStop(const std::string &stop_name) const {
-  if (!stops_.count(stop_name)) {
+  auto id = FindStop(stop_name);
+  if (!id) {
     return nullptr;
   }
-  return stops_.at(stop_name);
+  return stops_[*id];
+}
+
+std::shared_ptr<Stop> Database::TakeStop(StopId id) const {
+  return stops_.at(id);
+}
+
+void Database::SetDistance(StopId from, StopId to, int distance, bool overwrite) {
+  auto &row = added_distances_[from];
+  auto it = std::find_if(row.begin(), row.end(), [to](const RoadDistance &road) { return road.to == to; });
+  if (it == row.end()) {
+    row.push_back({to, distance});
+  } else if (overwrite) {
+    it->distance = distance;
+  }
+  frozen_ = false;
+}
+
+int Database::Distance(StopId from, StopId to) const {
+  if (frozen_) {
+    auto begin = distance_targets_.begin() + distance_offsets_[from];
+    auto end = distance_targets_.begin() + distance_offsets_[from + 1];
+    auto it = std::lower_bound(begin, end, to);
+    if (it != end && *it == to) {
+      return distance_values_[it - distance_targets_.begin()];
+    }
+  } else {
+    for (const auto &road : added_distances_.at(from)) {
+      if (road.to == to) {
+        return road.distance;
+      }
+    }
+  }
+  throw std::out_of_range("no road distance between stops " + stops_.at(from)->GetName()
+                              + " and " + stops_.at(to)->GetName());
+}
+
+void Database::Freeze() {
+  distance_offsets_.assign(1, 0);
+  distance_targets_.clear();
+  distance_values_.clear();
+  for (auto row : added_distances_) {
+    std::sort(row.begin(), row.end(), [](const RoadDistance &lhs, const RoadDistance &rhs) {
+      return lhs.to < rhs.to;
+    });
+    for (const auto &road : row) {
+      distance_targets_.push_back(road.to);
+      distance_values_.push_back(road.distance);
+    }
+    distance_offsets_.push_back(distance_targets_.size());
+  }
+  frozen_ = true;
+
+  std::vector<std::pair<uint32_t, Coordinates>> points;
+  points.reserve(stops_.size());
+  for (const auto &stop_ptr : stops_) {
+    points.emplace_back(stop_ptr->GetId(), stop_ptr->GetCoord());
+  }
+  spatial_index_ = SpatialIndex(points);
+
+  bus_stats_.assign(routes_.size(), std::nullopt);
+  for (const auto &route_ptr : routes_) {
+    try {
+      bus_stats_[route_ptr->GetId()] = ComputeBusStat(*route_ptr);
+    } catch (const std::out_of_range &) {
+      // Error is reported when the bus is requested
+    }
+  }
+  bus_stats_version_ = version_;
+}
+
+BusStat Database::ComputeBusStat(const Route &route) {
+  return {static_cast<uint32_t>(route.CountOfStops()),
+          static_cast<uint32_t>(route.CountOfUniqueStops()),
+          route.RealLength(),
+          route.Curvature()};
+}
+
+std::optional<BusStat> Database::TakeBusStat(const std::string &route_name) const {
+  auto it = route_ids_.find(route_name);
+  if (it == route_ids_.end()) {
+    return std::nullopt;
+  }
+  const BusId id = it->second;
+  if (id < bus_stats_.size() && bus_stats_[id] && rewrite_version_ <= bus_stats_version_) {
+    return bus_stats_[id];
+  }
+  return ComputeBusStat(*routes_[id]);
+}
+
+std::vector<SpatialIndex::Found> Database::NearestStops(Coordinates center, size_t count) const {
+  auto result = spatial_index_.Nearest(center, count);
+  if (spatial_index_.Size() < stops_.size()) {
+    for (size_t id = spatial_index_.Size(); id < stops_.size(); ++id) {
+      result.push_back({static_cast<StopId>(id), Coordinates::Distance(center, stops_[id]->GetCoord())});
+    }
+    std::sort(result.begin(), result.end(), [](const auto &lhs, const auto &rhs) {
+      return std::tie(lhs.distance, lhs.id) < std::tie(rhs.distance, rhs.id);
+    });
+    result.resize(std::min(result.size(), count));
+  }
+  return result;
+}
+
+std::vector<SpatialIndex::Found> Database::StopsWithinRadius(Coordinates center, double radius) const {
+  auto result = spatial_index_.WithinRadius(center, radius);
+  if (spatial_index_.Size() < stops_.size()) {
+    for (size_t id = spatial_index_.Size(); id < stops_.size(); ++id) {
+      const double distance = Coordinates::Distance(center, stops_[id]->GetCoord());
+      if (distance <= radius) {
+        result.push_back({static_cast<StopId>(id), distance});
+      }
+    }
+    std::sort(result.begin(), result.end(), [](const auto &lhs, const auto &rhs) {
+      return std::tie(lhs.distance, lhs.id) < std::tie(rhs.distance, rhs.id);
+    });
+  }
+  return result;
+}
+
+std::vector<StopId> Database::StopsInBox(Coordinates min_corner, Coordinates max_corner) const {
+  auto result = spatial_index_.InBox(min_corner, max_corner);
+  for (size_t id = spatial_index_.Size(); id < stops_.size(); ++id) {
+    const Coordinates coord = stops_[id]->GetCoord();
+    if (coord.GetLatitude() >= min_corner.GetLatitude() && coord.GetLatitude() <= max_corner.GetLatitude()
+        && coord.GetLongitude() >= min_corner.GetLongitude() && coord.GetLongitude() <= max_corner.GetLongitude()) {
+      result.push_back(static_cast<StopId>(id));
+    }
+  }
+  return result;
 }
 
 void Database::AddRoute(const std::string &route_name, std::shared_ptr<Route> route) {
-  for (const auto &stop_name : route->GetStopsName()) {
-    stops_[stop_name]->AddRoute(route_name);
+  auto inserted = route_ids_.try_emplace(route_name, static_cast<BusId>(routes_.size()));
+  const BusId id = inserted.first->second;
+  route->id_ = id;
+  ++version_;
+  for (const auto stop_id : route->GetStops()) {
+    stops_[stop_id]->AddRoute(route_name);
+  }
+  if (inserted.second) {
+    routes_.push_back(std::move(route));
+  } else {
+    routes_[id] = std::move(route);
+    rewrite_version_ = version_;
   }
-  routes_[route_name] = std::move(route);
 }
 
 std::shared_ptr<Route> Database::TakeRoute(const std::string &route_name) const {
-  if (routes_.count(route_name)) {
-    return routes_.at(route_name);
-  } else {
+  auto it = route_ids_.find(route_name);
+  if (it == route_ids_.end()) {
     return nullptr;
   }
+  return routes_[it->second];
 }
 
 std::shared_ptr<Route> RouteBuilder::MakeRoute(RouteInfo &&info) {
   switch (info.type) {
-  case Route::RouteTypes::LINEAR:return MakeLinear(std::move(info));
-  case Route::RouteTypes::CYCLE:return MakeCycle(std::move(info));
+  case Route::RouteTypes::LINEAR:return std::make_shared<LinearRoute>(db_, info.name, InternStops(info.stop_names));
+  case Route::RouteTypes::CYCLE:return std::make_shared<CycleRoute>(db_, info.name, InternStops(info.stop_names));
   default:return nullptr;
   }
 }
 
-std::shared_ptr<Route> RouteBuilder::MakeCycle(RouteInfo &&info) {
-  std::vector<std::shared_ptr<Stop>> stops_ptr;
-  stops_ptr.reserve(info.stop_names.size());
-  for (auto &str : info.stop_names) {
-    auto stop = db_.TakeOrAddStop(str);
-    stops_ptr.push_back(std::move(stop));
+std::vector<StopId> RouteBuilder::InternStops(const std::vector<std::string> &stop_names) {
+  std::vector<StopId> stops;
+  stops.reserve(stop_names.size());
+  for (const auto &str : stop_names) {
+    stops.push_back(db_.InternStop(str));
   }
-  return std::make_shared<CycleRoute>(std::move(info.name), std::move(info.stop_names), std::move(stops_ptr));
-}
-
-std::shared_ptr<Route> RouteBuilder::MakeLinear(RouteInfo &&info) {
-  std::vector<std::shared_ptr<Stop>> stops_ptr;
-  stops_ptr.reserve(info.stop_names.size());
-  for (auto &str : info.stop_names) {
-    auto stop = db_.TakeOrAddStop(str);
-    stops_ptr.push_back(std::move(stop));
-  }
-  return std::make_shared<LinearRoute>(std::move(info.name), std::move(info.stop_names), std::move(stops_ptr));
+  return stops;
 }
 
 const Database::StopData& Database::TakeStops() const {
@@ -221,7 +363,67 @@ const Database::RouteData& Database::TakeRoutes() const {
   return routes_;
 }
 
+const CoordinatesTable &Database::TakeStopPoints() const {
+  return stop_points_;
+}
+
 const DatabaseStat& Database::TakeStat() const {
   return stat;
 }
-}
\ No newline at end of file
+
+uint64_t Database::GetVersion() const {
+  return version_;
+}
+
+uint64_t Database::GetRewriteVersion() const {
+  return rewrite_version_;
+}
+
+void Database::Serialize(std::ostream &out) const {
+  Serialization::Serialize(stat, out);
+  Serialization::Serialize(static_cast<uint64_t>(stops_.size()), out);
+  for (const auto &stop_ptr : stops_) {
+    Serialization::Serialize(stop_ptr->GetName(), out);
+    Serialization::Serialize(stop_ptr->GetCoord(), out);
+    Serialization::Serialize(added_distances_[stop_ptr->GetId()], out);
+  }
+  Serialization::Serialize(static_cast<uint64_t>(routes_.size()), out);
+  for (const auto &route_ptr : routes_) {
+    Serialization::Serialize(route_ptr->GetName(), out);
+    Serialization::Serialize(route_ptr->route_type, out);
+    Serialization::Serialize(route_ptr->GetStops(), out);
+  }
+}
+
+void Database::Deserialize(Serialization::Reader &in) {
+  Serialization::Deserialize(in, stat);
+  uint64_t stops_count = 0;
+  Serialization::Deserialize(in, stops_count);
+  for (uint64_t i = 0; i < stops_count; ++i) {
+    std::string stop_name;
+    Coordinates coord;
+    Serialization::Deserialize(in, stop_name);
+    Serialization::Deserialize(in, coord);
+    const StopId id = InternStop(stop_name);
+    stops_[id]->coord_ = coord;
+    stop_points_.Set(id, coord);
+    Serialization::Deserialize(in, added_distances_[id]);
+  }
+  uint64_t routes_count = 0;
+  Serialization::Deserialize(in, routes_count);
+  for (uint64_t i = 0; i < routes_count; ++i) {
+    std::string route_name;
+    Route::RouteTypes type;
+    std::vector<StopId> stops;
+    Serialization::Deserialize(in, route_name);
+    Serialization::Deserialize(in, type);
+    Serialization::Deserialize(in, stops);
+    if (type == Route::RouteTypes::LINEAR) {
+      AddRoute(route_name, std::make_shared<LinearRoute>(*this, route_name, std::move(stops)));
+    } else {
+      AddRoute(route_name, std::make_shared<CycleRoute>(*this, route_name, std::move(stops)));
+    }
+  }
+  Freeze();
+}
+}
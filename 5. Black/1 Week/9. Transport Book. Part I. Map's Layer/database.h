@@ -11,35 +11,41 @@
 #include <set>
 #include <memory>
 #include <list>
+#include <limits>
+#include <optional>
 
 #include "graph.h"
 #include "dijkstra.h"
 #include "json.h"
 #include "coordinates.h"
+#include "serialization.h"
+#include "spatial_index.h"
 
 namespace TransportDatabase {
+// Dense ids given to names of stops and buses while adding them to database
+using StopId = uint32_t;
+using BusId = uint32_t;
+
+class Database;
+
 class Stop {
 public:
 
   Stop();
   Stop(std::string name, const Coordinates &coord);
-  Stop(std::string name, const Coordinates &coord, const std::vector<std::pair<std::string, int>> &distances);
-  Stop(const Stop &other);
-  Stop(Stop &&other) noexcept;
-  Stop &operator=(const Stop &other);
-  Stop &operator=(Stop &&other) noexcept;
 
-  std::string GetName() const;
+  const std::string &GetName() const;
   Coordinates GetCoord() const;
+  StopId GetId() const;
 
   void AddRoute(const std::string &route_name);
   std::vector<std::string> TakeRoutes() const;
 
   bool operator==(const Stop &other) const;
   bool operator!=(const Stop &other) const;
-
-  std::unordered_map<std::string, int> distance_to_stop;
 private:
+  friend class Database;
+  StopId id_ = 0;
   std::string name_;
   Coordinates coord_;
   std::set<std::string> routes_for_stop;
@@ -48,21 +54,27 @@ private:
 class Route {
 public:
   enum class RouteTypes { LINEAR, CYCLE };
-  explicit Route(const std::string &name, const std::vector<std::string> &stops_name, RouteTypes type)
-      : route_type(type), name_(name), stops_name_(stops_name) {}
+  explicit Route(const Database &db, const std::string &name, std::vector<StopId> stops, RouteTypes type);
   virtual ~Route() = default;
   virtual size_t CountOfStops() const = 0;
   virtual size_t CountOfUniqueStops() const = 0;
   virtual double RealLength() const = 0;
   virtual double Length() const = 0;
   double Curvature() const;
-  std::string GetName() const;
+  const std::string &GetName() const;
+  BusId GetId() const;
+  const std::vector<StopId> &GetStops() const;
   std::vector<std::string> GetStopsName() const;
 
   RouteTypes route_type;
 protected:
+  friend class Database;
+  const Database &db_;
+  BusId id_ = 0;
   std::string name_;
-  std::vector<std::string> stops_name_;
+  // Порядок остановок маршрута
+  std::vector<StopId> stops_;
+  size_t unique_stops_count_;
 };
 
 static const std::unordered_map<char, Route::RouteTypes> sign_to_route = {{'-', Route::RouteTypes::LINEAR},
@@ -70,44 +82,22 @@ static const std::unordered_map<char, Route::RouteTypes> sign_to_route = {{'-',
 
 class LinearRoute : public Route {
 public:
-  LinearRoute() = default;
-  explicit LinearRoute(const std::string &name, const std::vector<std::string> &stops_name,
-                       const std::vector<std::shared_ptr<Stop>> &stops) : Route(name, stops_name, RouteTypes::LINEAR),
-                                                                          stops_(stops) {
-    for (const auto &elem : stops_name_) {
-      unique_stops_.insert(elem);
-    }
-  }
+  explicit LinearRoute(const Database &db, const std::string &name, std::vector<StopId> stops)
+      : Route(db, name, std::move(stops), RouteTypes::LINEAR) {}
   size_t CountOfStops() const override;
   size_t CountOfUniqueStops() const override;
   double RealLength() const override;
   double Length() const override;
-private:
-  // Порядок маршрутов с данными о остановках
-  std::vector<std::shared_ptr<Stop>> stops_;
-  // Хранение уникальных остановок
-  std::unordered_set<std::string_view> unique_stops_;
 };
 
 class CycleRoute : public Route {
 public:
-  CycleRoute() = default;
-  explicit CycleRoute(const std::string &name, const std::vector<std::string> &stops_name,
-                      const std::vector<std::shared_ptr<Stop>> &stops) : Route(name, stops_name, RouteTypes::CYCLE),
-                                                                         stops_(stops) {
-    for (const auto &elem : stops_name_) {
-      unique_stops_.insert(elem);
-    }
-  }
+  explicit CycleRoute(const Database &db, const std::string &name, std::vector<StopId> stops)
+      : Route(db, name, std::move(stops), RouteTypes::CYCLE) {}
   size_t CountOfStops() const override;
   size_t CountOfUniqueStops() const override;
   double RealLength() const override;
   double Length() const override;
-private:
-  // Порядок маршрутов с данными о остановках
-  std::vector<std::shared_ptr<Stop>> stops_;
-  // Хранение уникальных остановок
-  std::unordered_set<std::string_view> unique_stops_;
 };
 
 struct RouteInfo {
@@ -116,6 +106,14 @@ struct RouteInfo {
   std::vector<std::string> stop_names;
 };
 
+// Answer to bus request, computed once for every bus by Freeze
+struct BusStat {
+  uint32_t stop_count;
+  uint32_t unique_stop_count;
+  double real_length;
+  double curvature;
+};
+
 struct DatabaseStat {
   double min_lat = std::numeric_limits<double>::max();
   double max_lat = 0;
@@ -125,24 +123,85 @@ struct DatabaseStat {
 
 class Database {
 public:
-  using StopData = std::unordered_map<std::string, std::shared_ptr<Stop>>;
-  using RouteData = std::unordered_map<std::string, std::shared_ptr<Route>>;
+  // Indexed by id of stop or bus
+  using StopData = std::vector<std::shared_ptr<Stop>>;
+  using RouteData = std::vector<std::shared_ptr<Route>>;
   Database() = default;
-  void AddStop(const Stop &stop);
+  Database(const Database &) = delete;
+  Database &operator=(const Database &) = delete;
+
+  void AddStop(const Stop &stop, const std::vector<std::pair<std::string, int>> &distances = {});
+  // Gives id to the name even if stop is not described yet
+  StopId InternStop(const std::string &stop_name);
+  std::optional<StopId> FindStop(const std::string &stop_name) const;
   std::shared_ptr<Stop> TakeOrAddStop(const std::string &stop_name);
   std::shared_ptr<Stop> TakeStop(const std::string &stop_name) const;
+  std::shared_ptr<Stop> TakeStop(StopId id) const;
   const StopData& TakeStops() const;
+  // Road distance between neighbour stops, throws std::out_of_range if unknown
+  int Distance(StopId from, StopId to) const;
+  // Coordinates of stops by id for batches of great circle distances
+  const CoordinatesTable &TakeStopPoints() const;
+
+  // Searches by coordinates go through the index built by Freeze,
+  // stops added after it are checked one by one
+  std::vector<SpatialIndex::Found> NearestStops(Coordinates center, size_t count) const;
+  std::vector<SpatialIndex::Found> StopsWithinRadius(Coordinates center, double radius) const;
+  std::vector<StopId> StopsInBox(Coordinates min_corner, Coordinates max_corner) const;
 
   void AddRoute(const std::string &route_name, std::shared_ptr<Route> route);
   std::shared_ptr<Route> TakeRoute(const std::string &route_name) const;
   // TODO возвращать контейнер, который НЕ позволяет изменять хранимые значения?
   const RouteData& TakeRoutes() const;
+  // Precomputed if nothing of the bus changed after Freeze,
+  // throws std::out_of_range if road distances are missing
+  std::optional<BusStat> TakeBusStat(const std::string &route_name) const;
 
   const DatabaseStat& TakeStat() const;
+  // Grows with every change of stops or routes, so results built
+  // from the database can tell if they are still valid
+  uint64_t GetVersion() const;
+  // Version of the last change which is not just an addition: a stop
+  // used by buses got new distances or a bus was replaced
+  uint64_t GetRewriteVersion() const;
+
+  // Packs distances into flat table, indexes stops by coordinates and
+  // computes stats of buses, called when all base requests are done.
+  // Database stays usable for new requests, they are just slower until next freeze
+  void Freeze();
+
+  void Serialize(std::ostream& out) const;
+  // Fills empty database with stops and routes saved by Serialize
+  void Deserialize(Serialization::Reader& in);
 private:
+  struct RoadDistance {
+    StopId to;
+    int32_t distance;
+  };
+  // Distance given for opposite direction is used only until this one is given
+  void SetDistance(StopId from, StopId to, int distance, bool overwrite);
+  static BusStat ComputeBusStat(const Route &route);
+
   DatabaseStat stat;
+  uint64_t version_ = 0;
+  uint64_t rewrite_version_ = 0;
   StopData stops_;
+  std::unordered_map<std::string, StopId> stop_ids_;
+  CoordinatesTable stop_points_;
   RouteData routes_;
+  std::unordered_map<std::string, BusId> route_ids_;
+
+  // Distances as they come with requests
+  std::vector<std::vector<RoadDistance>> added_distances_;
+  // CSR table of distances: row of stop is in [offsets[id], offsets[id + 1]), sorted by target
+  bool frozen_ = false;
+  std::vector<size_t> distance_offsets_;
+  std::vector<StopId> distance_targets_;
+  std::vector<int32_t> distance_values_;
+  SpatialIndex spatial_index_;
+  // By bus id, no value if distances of bus were missing
+  std::vector<std::optional<BusStat>> bus_stats_;
+  uint64_t bus_stats_version_ = 0;
 };
 
 class RouteBuilder {
@@ -152,8 +211,7 @@ public:
   std::shared_ptr<Route> MakeRoute(RouteInfo &&info);
 private:
   Database &db_;
-  std::shared_ptr<Route> MakeCycle(RouteInfo &&info);
-  std::shared_ptr<Route> MakeLinear(RouteInfo &&info);
+  std::vector<StopId> InternStops(const std::vector<std::string> &stop_names);
 };
 }
 #endif //YANDEXCPLUSPLUS_4_BROWN_FINAL_PROJECT_PART_A_DATABASE_H
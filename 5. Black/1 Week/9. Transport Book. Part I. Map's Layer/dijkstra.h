@@ -1,99 +1,163 @@
   #pragma once
 
 #include "graph.h"
+#include "base_router.h"
 
 #include <algorithm>
 #include <cassert>
 #include <cstdint>
 #include <iterator>
+#include <limits>
 #include <optional>
+#include <stdexcept>
 #include <unordered_map>
 #include <utility>
 #include <vector>
 
 namespace Graph {
 
-  template <typename Weight>
-  class Router {
-  private:
-    using Graph = DirectedWeightedGraph<Weight>;
+  // Layouts of the all-pairs table for Router. Relax stores the route
+  // if there is none yet or the candidate is shorter in stored precision
 
+  // Every cell keeps optional weight and previous edge, about 32 bytes
+  template <typename Weight>
+  class OptionalRoutesTable {
   public:
-    Router(const Graph& graph);
+    OptionalRoutesTable(size_t vertex_count, size_t /* edge_count */)
+        : data_(vertex_count, std::vector<std::optional<RouteInternalData>>(vertex_count)) {}
 
-    using RouteId = uint64_t;
+    bool Has(VertexId from, VertexId to) const {
+      return data_[from][to].has_value();
+    }
+    Weight GetWeight(VertexId from, VertexId to) const {
+      return data_[from][to]->weight;
+    }
+    std::optional<EdgeId> GetPrevEdge(VertexId from, VertexId to) const {
+      return data_[from][to]->prev_edge;
+    }
+    void Relax(VertexId from, VertexId to, Weight weight, std::optional<EdgeId> prev_edge) {
+      auto& route = data_[from][to];
+      if (!route || weight < route->weight) {
+        route = RouteInternalData{weight, prev_edge};
+      }
+    }
 
-    struct RouteInfo {
-      RouteId id;
+  private:
+    struct RouteInternalData {
       Weight weight;
-      size_t edge_count;
+      std::optional<EdgeId> prev_edge;
     };
+    std::vector<std::vector<std::optional<RouteInternalData>>> data_;
+  };
 
-    std::optional<RouteInfo> BuildRoute(VertexId from, VertexId to) const;
-    EdgeId GetRouteEdge(RouteId route_id, size_t edge_idx) const;
-    void ReleaseRoute(RouteId route_id);
+  // Two flat row-major arrays of narrow types with sentinels instead of
+  // optional, 8 bytes per cell with defaults. Weights are rounded to
+  // StoredWeight while relaxing, so with float they carry relative error
+  // about 1e-7 per edge of the route. Graph must have fewer edges than
+  // StoredEdgeId holds
+  template <typename Weight, typename StoredWeight = float, typename StoredEdgeId = uint32_t>
+  class CompactRoutesTable {
+  public:
+    CompactRoutesTable(size_t vertex_count, size_t edge_count)
+        : vertex_count_(vertex_count),
+          weights_(vertex_count * vertex_count, NO_WEIGHT),
+          prev_edges_(vertex_count * vertex_count, NO_EDGE)
+    {
+      if (edge_count >= NO_EDGE) {
+        throw std::runtime_error("too many edges for compact routes table");
+      }
+    }
+
+    bool Has(VertexId from, VertexId to) const {
+      return weights_[Index(from, to)] != NO_WEIGHT;
+    }
+    Weight GetWeight(VertexId from, VertexId to) const {
+      return weights_[Index(from, to)];
+    }
+    std::optional<EdgeId> GetPrevEdge(VertexId from, VertexId to) const {
+      const StoredEdgeId edge_id = prev_edges_[Index(from, to)];
+      return edge_id == NO_EDGE ? std::nullopt : std::optional<EdgeId>(edge_id);
+    }
+    void Relax(VertexId from, VertexId to, Weight weight, std::optional<EdgeId> prev_edge) {
+      const size_t idx = Index(from, to);
+      const auto stored_weight = static_cast<StoredWeight>(weight);
+      if (stored_weight < weights_[idx]) {
+        weights_[idx] = stored_weight;
+        prev_edges_[idx] = prev_edge ? static_cast<StoredEdgeId>(*prev_edge) : NO_EDGE;
+      }
+    }
 
   private:
-    const Graph& graph_;
+    static constexpr StoredEdgeId NO_EDGE = std::numeric_limits<StoredEdgeId>::max();
+    static constexpr StoredWeight NO_WEIGHT = std::numeric_limits<StoredWeight>::has_infinity
+                                              ? std::numeric_limits<StoredWeight>::infinity()
+                                              : std::numeric_limits<StoredWeight>::max();
 
-    struct RouteInternalData {
-      Weight weight;
-      std::optional<EdgeId> prev_edge;
-    };
-    using RoutesInternalData = std::vector<std::vector<std::optional<RouteInternalData>>>;
+    size_t Index(VertexId from, VertexId to) const {
+      return from * vertex_count_ + to;
+    }
+
+    size_t vertex_count_;
+    std::vector<StoredWeight> weights_;
+    std::vector<StoredEdgeId> prev_edges_;
+  };
+
+  template <typename Weight, typename Table = OptionalRoutesTable<Weight>>
+  class Router : public BaseRouter<Weight> {
+  private:
+    using Graph = DirectedWeightedGraph<Weight>;
+
+  public:
+    Router(const Graph& graph);
 
-    using ExpandedRoute = std::vector<EdgeId>;
-    mutable RouteId next_route_id_ = 0;
-    mutable std::unordered_map<RouteId, ExpandedRoute> expanded_routes_cache_;
+    using typename BaseRouter<Weight>::RouteId;
+    using typename BaseRouter<Weight>::RouteInfo;
+
+    std::optional<Weight> BuildRouteEdges(VertexId from, VertexId to, std::vector<EdgeId>& edges) const override;
+    std::vector<std::optional<Weight>> BuildWeightMatrix(const std::vector<VertexId>& sources,
+                                                         const std::vector<VertexId>& targets) const override;
+
+  private:
+    const Graph& graph_;
 
     void InitializeRoutesInternalData(const Graph& graph) {
       const size_t vertex_count = graph.GetVertexCount();
       for (VertexId vertex = 0; vertex < vertex_count; ++vertex) {
-        routes_internal_data_[vertex][vertex] = RouteInternalData{0, std::nullopt};
+        routes_internal_data_.Relax(vertex, vertex, 0, std::nullopt);
         for (const EdgeId edge_id : graph.GetIncidentEdges(vertex)) {
           const auto& edge = graph.GetEdge(edge_id);
           assert(edge.weight >= 0);
-          auto& route_internal_data = routes_internal_data_[vertex][edge.to];
-          if (!route_internal_data || route_internal_data->weight > edge.weight) {
-            route_internal_data = RouteInternalData{edge.weight, edge_id};
-          }
+          routes_internal_data_.Relax(vertex, edge.to, edge.weight, edge_id);
         }
       }
     }
 
-    void RelaxRoute(VertexId vertex_from, VertexId vertex_to, const RouteInternalData& route_from, const RouteInternalData& route_to) {
-      auto& route_relaxing = routes_internal_data_[vertex_from][vertex_to];
-      const Weight candidate_weight = route_from.weight + route_to.weight;
-      if (!route_relaxing || candidate_weight < route_relaxing->weight) {
-        route_relaxing = {
-            candidate_weight,
-            route_to.prev_edge
-                ? route_to.prev_edge
-                : route_from.prev_edge
-        };
-      }
-    }
-
     void RelaxRoutesInternalDataThroughVertex(size_t vertex_count, VertexId vertex_through) {
       for (VertexId vertex_from = 0; vertex_from < vertex_count; ++vertex_from) {
-        if (const auto& route_from = routes_internal_data_[vertex_from][vertex_through]) {
-          for (VertexId vertex_to = 0; vertex_to < vertex_count; ++vertex_to) {
-            if (const auto& route_to = routes_internal_data_[vertex_through][vertex_to]) {
-              RelaxRoute(vertex_from, vertex_to, *route_from, *route_to);
-            }
+        if (!routes_internal_data_.Has(vertex_from, vertex_through)) {
+          continue;
+        }
+        const Weight weight_from = routes_internal_data_.GetWeight(vertex_from, vertex_through);
+        const std::optional<EdgeId> edge_from = routes_internal_data_.GetPrevEdge(vertex_from, vertex_through);
+        for (VertexId vertex_to = 0; vertex_to < vertex_count; ++vertex_to) {
+          if (routes_internal_data_.Has(vertex_through, vertex_to)) {
+            const std::optional<EdgeId> edge_to = routes_internal_data_.GetPrevEdge(vertex_through, vertex_to);
+            routes_internal_data_.Relax(vertex_from, vertex_to,
+                                        weight_from + routes_internal_data_.GetWeight(vertex_through, vertex_to),
+                                        edge_to ? edge_to : edge_from);
           }
         }
       }
     }
 
-    RoutesInternalData routes_internal_data_;
+    Table routes_internal_data_;
   };
 
 
-  template <typename Weight>
-  Router<Weight>::Router(const Graph& graph)
+  template <typename Weight, typename Table>
+  Router<Weight, Table>::Router(const Graph& graph)
       : graph_(graph),
-        routes_internal_data_(graph.GetVertexCount(), std::vector<std::optional<RouteInternalData>>(graph.GetVertexCount()))
+        routes_internal_data_(graph.GetVertexCount(), graph.GetEdgeCount())
   {
     InitializeRoutesInternalData(graph);
 
@@ -103,35 +167,36 @@ namespace Graph {
     }
   }
 
-  template <typename Weight>
-  std::optional<typename Router<Weight>::RouteInfo> Router<Weight>::BuildRoute(VertexId from, VertexId to) const {
-    const auto& route_internal_data = routes_internal_data_[from][to];
-    if (!route_internal_data) {
+  // Previous edges of one route are all in the row of from
+  template <typename Weight, typename Table>
+  std::optional<Weight> Router<Weight, Table>::BuildRouteEdges(VertexId from, VertexId to,
+                                                               std::vector<EdgeId>& edges) const {
+    edges.clear();
+    if (!routes_internal_data_.Has(from, to)) {
       return std::nullopt;
     }
-    const Weight weight = route_internal_data->weight;
-    std::vector<EdgeId> edges;
-    for (std::optional<EdgeId> edge_id = route_internal_data->prev_edge;
+    for (std::optional<EdgeId> edge_id = routes_internal_data_.GetPrevEdge(from, to);
          edge_id;
-         edge_id = routes_internal_data_[from][graph_.GetEdge(*edge_id).from]->prev_edge) {
+         edge_id = routes_internal_data_.GetPrevEdge(from, graph_.GetEdge(*edge_id).from)) {
       edges.push_back(*edge_id);
     }
     std::reverse(std::begin(edges), std::end(edges));
-
-    const RouteId route_id = next_route_id_++;
-    const size_t route_edge_count = edges.size();
-    expanded_routes_cache_[route_id] = std::move(edges);
-    return RouteInfo{route_id, weight, route_edge_count};
+    return routes_internal_data_.GetWeight(from, to);
   }
 
-  template <typename Weight>
-  EdgeId Router<Weight>::GetRouteEdge(RouteId route_id, size_t edge_idx) const {
-    return expanded_routes_cache_.at(route_id)[edge_idx];
-  }
-
-  template <typename Weight>
-  void Router<Weight>::ReleaseRoute(RouteId route_id) {
-    expanded_routes_cache_.erase(route_id);
+  template <typename Weight, typename Table>
+  std::vector<std::optional<Weight>> Router<Weight, Table>::BuildWeightMatrix(const std::vector<VertexId>& sources,
+                                                                              const std::vector<VertexId>& targets) const {
+    std::vector<std::optional<Weight>> weights;
+    weights.reserve(sources.size() * targets.size());
+    for (const VertexId from : sources) {
+      for (const VertexId to : targets) {
+        weights.push_back(routes_internal_data_.Has(from, to)
+                          ? std::optional<Weight>(routes_internal_data_.GetWeight(from, to))
+                          : std::nullopt);
+      }
+    }
+    return weights;
   }
 
 }
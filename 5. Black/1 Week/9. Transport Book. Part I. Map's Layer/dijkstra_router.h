@@ -0,0 +1,192 @@
+#pragma once
+
+#include "graph.h"
+#include "base_router.h"
+
+#include <algorithm>
+#include <cassert>
+#include <functional>
+#include <limits>
+#include <optional>
+#include <queue>
+#include <utility>
+#include <vector>
+
+namespace Graph {
+
+  // Buffers of a single Dijkstra search. They are reset only in touched
+  // cells, so a query costs nothing for unreached vertices.
+  template <typename Weight>
+  struct DijkstraSearchState {
+    static constexpr EdgeId NO_EDGE = std::numeric_limits<EdgeId>::max();
+
+    std::vector<Weight> distance;
+    std::vector<EdgeId> prev_edge;
+    std::vector<char> reached;
+    std::vector<VertexId> touched;
+
+    void Prepare(size_t vertex_count);
+    void Reach(VertexId vertex, Weight weight, EdgeId edge);
+    void Reset();
+
+    // Search buffers are shared by all routers of the thread,
+    // Tag tells apart searches that must live at the same time
+    template <int Tag = 0>
+    static DijkstraSearchState& ForThread();
+  };
+
+
+  template <typename Weight>
+  void DijkstraSearchState<Weight>::Prepare(size_t vertex_count) {
+    if (reached.size() < vertex_count) {
+      distance.resize(vertex_count);
+      prev_edge.resize(vertex_count, NO_EDGE);
+      reached.resize(vertex_count, false);
+    }
+  }
+
+  template <typename Weight>
+  void DijkstraSearchState<Weight>::Reach(VertexId vertex, Weight weight, EdgeId edge) {
+    if (!reached[vertex]) {
+      reached[vertex] = true;
+      touched.push_back(vertex);
+    }
+    distance[vertex] = weight;
+    prev_edge[vertex] = edge;
+  }
+
+  template <typename Weight>
+  void DijkstraSearchState<Weight>::Reset() {
+    for (const VertexId vertex : touched) {
+      reached[vertex] = false;
+      prev_edge[vertex] = NO_EDGE;
+    }
+    touched.clear();
+  }
+
+  template <typename Weight>
+  template <int Tag>
+  DijkstraSearchState<Weight>& DijkstraSearchState<Weight>::ForThread() {
+    static thread_local DijkstraSearchState state;
+    return state;
+  }
+
+
+  // Router without precomputation: every BuildRoute runs Dijkstra
+  // from scratch. Uses O(V + E) memory, so it can be built instantly
+  // for graphs where the all-pairs table of Router does not fit.
+  template <typename Weight>
+  class DijkstraRouter : public BaseRouter<Weight> {
+  private:
+    using Graph = DirectedWeightedGraph<Weight>;
+
+  public:
+    DijkstraRouter(const Graph& graph);
+
+    using typename BaseRouter<Weight>::RouteId;
+    using typename BaseRouter<Weight>::RouteInfo;
+
+    std::optional<Weight> BuildRouteEdges(VertexId from, VertexId to, std::vector<EdgeId>& edges) const override;
+    // One search from every source, it stops when all targets are settled
+    std::vector<std::optional<Weight>> BuildWeightMatrix(const std::vector<VertexId>& sources,
+                                                         const std::vector<VertexId>& targets) const override;
+
+  private:
+    using SearchState = DijkstraSearchState<Weight>;
+    static constexpr EdgeId NO_EDGE = SearchState::NO_EDGE;
+
+    const Graph& graph_;
+  };
+
+  template <typename Weight>
+  DijkstraRouter<Weight>::DijkstraRouter(const Graph& graph) : graph_(graph) {}
+
+  template <typename Weight>
+  std::optional<Weight> DijkstraRouter<Weight>::BuildRouteEdges(VertexId from, VertexId to,
+                                                                std::vector<EdgeId>& edges) const {
+    using QueueItem = std::pair<Weight, VertexId>;
+    edges.clear();
+    SearchState& state = SearchState::ForThread();
+    state.Prepare(graph_.GetVertexCount());
+
+    std::priority_queue<QueueItem, std::vector<QueueItem>, std::greater<>> queue;
+    state.Reach(from, 0, NO_EDGE);
+    queue.push({0, from});
+    while (!queue.empty()) {
+      const auto [weight, vertex] = queue.top();
+      queue.pop();
+      if (weight > state.distance[vertex]) {
+        continue;
+      }
+      if (vertex == to) {
+        break;
+      }
+      for (const EdgeId edge_id : graph_.GetIncidentEdges(vertex)) {
+        const auto& edge = graph_.GetEdge(edge_id);
+        assert(edge.weight >= 0);
+        const Weight candidate_weight = weight + edge.weight;
+        if (!state.reached[edge.to] || candidate_weight < state.distance[edge.to]) {
+          state.Reach(edge.to, candidate_weight, edge_id);
+          queue.push({candidate_weight, edge.to});
+        }
+      }
+    }
+
+    if (!state.reached[to]) {
+      state.Reset();
+      return std::nullopt;
+    }
+    const Weight weight = state.distance[to];
+    for (EdgeId edge_id = state.prev_edge[to]; edge_id != NO_EDGE;
+         edge_id = state.prev_edge[graph_.GetEdge(edge_id).from]) {
+      edges.push_back(edge_id);
+    }
+    std::reverse(std::begin(edges), std::end(edges));
+    state.Reset();
+    return weight;
+  }
+
+  template <typename Weight>
+  std::vector<std::optional<Weight>> DijkstraRouter<Weight>::BuildWeightMatrix(const std::vector<VertexId>& sources,
+                                                                               const std::vector<VertexId>& targets) const {
+    using QueueItem = std::pair<Weight, VertexId>;
+    SearchState& state = SearchState::ForThread();
+    state.Prepare(graph_.GetVertexCount());
+    std::vector<VertexId> unique_targets = targets;
+    std::sort(unique_targets.begin(), unique_targets.end());
+    unique_targets.erase(std::unique(unique_targets.begin(), unique_targets.end()), unique_targets.end());
+
+    std::vector<std::optional<Weight>> weights;
+    weights.reserve(sources.size() * targets.size());
+    for (const VertexId from : sources) {
+      std::priority_queue<QueueItem, std::vector<QueueItem>, std::greater<>> queue;
+      size_t targets_left = unique_targets.size();
+      state.Reach(from, 0, NO_EDGE);
+      queue.push({0, from});
+      while (!queue.empty() && targets_left > 0) {
+        const auto [weight, vertex] = queue.top();
+        queue.pop();
+        if (weight > state.distance[vertex]) {
+          continue;
+        }
+        if (std::binary_search(unique_targets.begin(), unique_targets.end(), vertex)) {
+          --targets_left;
+        }
+        for (const EdgeId edge_id : graph_.GetIncidentEdges(vertex)) {
+          const auto& edge = graph_.GetEdge(edge_id);
+          const Weight candidate_weight = weight + edge.weight;
+          if (!state.reached[edge.to] || candidate_weight < state.distance[edge.to]) {
+            state.Reach(edge.to, candidate_weight, edge_id);
+            queue.push({candidate_weight, edge.to});
+          }
+        }
+      }
+      for (const VertexId to : targets) {
+        weights.push_back(state.reached[to] ? std::optional<Weight>(state.distance[to]) : std::nullopt);
+      }
+      state.Reset();
+    }
+    return weights;
+  }
+
+}
@@ -0,0 +1,63 @@
+//
+// Created by ilya on 03.06.2020.
+//
+
+#ifndef YANDEXCPLUSPLUS_5_BLACK_1_WEEK_9_TRANSPORT_BOOK_PART_I_EXECUTOR_H
+#define YANDEXCPLUSPLUS_5_BLACK_1_WEEK_9_TRANSPORT_BOOK_PART_I_EXECUTOR_H
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace TransportDatabase {
+// Runs task(idx) for every idx in [0, count) on a pool of threads.
+// Threads take indices one by one, so a slow task does not hold
+// the others. The first exception is rethrown when all threads stop.
+// thread_count = 0 means one thread per hardware core
+template<typename Task>
+void ParallelFor(size_t count, const Task &task, size_t thread_count = 0) {
+  if (thread_count == 0) {
+    thread_count = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+  }
+  thread_count = std::min(thread_count, count);
+  if (thread_count <= 1) {
+    for (size_t idx = 0; idx < count; ++idx) {
+      task(idx);
+    }
+    return;
+  }
+
+  std::atomic<size_t> next_idx = 0;
+  std::exception_ptr error;
+  std::mutex error_mutex;
+  auto worker = [&] {
+    for (size_t idx = next_idx++; idx < count; idx = next_idx++) {
+      try {
+        task(idx);
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(error_mutex);
+        if (!error) {
+          error = std::current_exception();
+        }
+        next_idx = count;
+      }
+    }
+  };
+  std::vector<std::thread> threads;
+  for (size_t thread_idx = 1; thread_idx < thread_count; ++thread_idx) {
+    threads.emplace_back(worker);
+  }
+  worker();
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
+}
+
+#endif //YANDEXCPLUSPLUS_5_BLACK_1_WEEK_9_TRANSPORT_BOOK_PART_I_EXECUTOR_H
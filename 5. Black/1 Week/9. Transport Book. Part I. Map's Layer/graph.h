@@ -30,6 +30,9 @@ namespace Graph {
     Weight weight;
   };
 
+  // Edges leaving every vertex are kept together in one array, ordered by
+  // vertex and then by id, so a vertex is two offsets instead of a vector.
+  // Index is rebuilt on every addition, edges are better added in batches
   template <typename Weight>
   class DirectedWeightedGraph {
   private:
@@ -39,6 +42,10 @@ namespace Graph {
     DirectedWeightedGraph() = default;
     DirectedWeightedGraph(size_t vertex_count);
     EdgeId AddEdge(const Edge<Weight>& edge);
+    // Edges get ids in the order of the batch, returns id of the first one
+    EdgeId AddEdges(std::vector<Edge<Weight>> edges);
+    // Returns id of the first added vertex
+    VertexId AddVertices(size_t count);
 
     size_t GetVertexCount() const;
     size_t GetEdgeCount() const;
@@ -46,25 +53,49 @@ namespace Graph {
     IncidentEdgesRange GetIncidentEdges(VertexId vertex) const;
 
   private:
+    // Adds edges from first_new to the end of edges_ into incidence
+    void IndexEdges(EdgeId first_new);
+
     std::vector<Edge<Weight>> edges_;
-    std::vector<IncidenceList> incidence_lists_;
+    // Edges leaving vertex v are incident_edges_[offsets_[v], offsets_[v + 1])
+    std::vector<size_t> offsets_ = {0};
+    IncidenceList incident_edges_;
   };
 
 
   template <typename Weight>
-  DirectedWeightedGraph<Weight>::DirectedWeightedGraph(size_t vertex_count) : incidence_lists_(vertex_count) {}
+  DirectedWeightedGraph<Weight>::DirectedWeightedGraph(size_t vertex_count) : offsets_(vertex_count + 1, 0) {}
 
   template <typename Weight>
   EdgeId DirectedWeightedGraph<Weight>::AddEdge(const Edge<Weight>& edge) {
     edges_.push_back(edge);
     const EdgeId id = edges_.size() - 1;
-    incidence_lists_[edge.from].push_back(id);
+    IndexEdges(id);
     return id;
   }
 
+  template <typename Weight>
+  EdgeId DirectedWeightedGraph<Weight>::AddEdges(std::vector<Edge<Weight>> edges) {
+    const EdgeId first = edges_.size();
+    if (edges_.empty()) {
+      edges_ = std::move(edges);
+    } else {
+      edges_.insert(edges_.end(), edges.begin(), edges.end());
+    }
+    IndexEdges(first);
+    return first;
+  }
+
+  template <typename Weight>
+  VertexId DirectedWeightedGraph<Weight>::AddVertices(size_t count) {
+    const VertexId first = GetVertexCount();
+    offsets_.resize(offsets_.size() + count, offsets_.back());
+    return first;
+  }
+
   template <typename Weight>
   size_t DirectedWeightedGraph<Weight>::GetVertexCount() const {
-    return incidence_lists_.size();
+    return offsets_.size() - 1;
   }
 
   template <typename Weight>
@@ -80,7 +111,35 @@ namespace Graph {
   template <typename Weight>
   typename DirectedWeightedGraph<Weight>::IncidentEdgesRange
   DirectedWeightedGraph<Weight>::GetIncidentEdges(VertexId vertex) const {
-    const auto& edges = incidence_lists_[vertex];
-    return {std::begin(edges), std::end(edges)};
+    return {incident_edges_.begin() + offsets_[vertex], incident_edges_.begin() + offsets_[vertex + 1]};
+  }
+
+  // New edges have greater ids, so they go after old ones of their vertex
+  template <typename Weight>
+  void DirectedWeightedGraph<Weight>::IndexEdges(EdgeId first_new) {
+    const size_t vertex_count = GetVertexCount();
+    std::vector<size_t> offsets(vertex_count + 1, 0);
+    for (VertexId vertex = 0; vertex < vertex_count; ++vertex) {
+      offsets[vertex + 1] = offsets_[vertex + 1] - offsets_[vertex];
+    }
+    for (EdgeId edge_id = first_new; edge_id < edges_.size(); ++edge_id) {
+      ++offsets[edges_[edge_id].from + 1];
+    }
+    for (VertexId vertex = 0; vertex < vertex_count; ++vertex) {
+      offsets[vertex + 1] += offsets[vertex];
+    }
+
+    IncidenceList incident_edges(edges_.size());
+    std::vector<size_t> positions(offsets.begin(), offsets.end() - 1);
+    for (VertexId vertex = 0; vertex < vertex_count; ++vertex) {
+      for (size_t idx = offsets_[vertex]; idx < offsets_[vertex + 1]; ++idx) {
+        incident_edges[positions[vertex]++] = incident_edges_[idx];
+      }
+    }
+    for (EdgeId edge_id = first_new; edge_id < edges_.size(); ++edge_id) {
+      incident_edges[positions[edges_[edge_id].from]++] = edge_id;
+    }
+    offsets_ = std::move(offsets);
+    incident_edges_ = std::move(incident_edges);
   }
 }
@@ -1,99 +1,361 @@
 #include "json.h"
 
+#include <cctype>
+#include <charconv>
+#include <optional>
+
 using namespace std;
 
 namespace Json {
 
-  Node LoadArray(istream& input) {
-    vector<Node> result;
+  namespace {
+    // Builds nodes from parser events
+    class DocumentBuilder : public Handler {
+    public:
+      DocumentBuilder() = default;
+      DocumentBuilder(string stream_key, function<void(Node)> on_element)
+          : stream_key_(move(stream_key)), on_element_(move(on_element)) {}
 
-    for (char c; input >> c && c != ']'; ) {
-      if (c != ',') {
-        input.putback(c);
+      Node TakeRoot() {
+        if (!root_) {
+          throw ParsingError("empty document");
+        }
+        return move(*root_);
+      }
+
+      void StartArray() override {
+        const bool streamed = on_element_ && stack_.size() == 1
+                              && holds_alternative<Dict>(stack_.back().value)
+                              && stack_.back().key == stream_key_;
+        stack_.push_back({Node(vector<Node>()), {}, streamed});
+      }
+      void EndArray() override { Close(); }
+      void StartObject() override { stack_.push_back({Node(Dict()), {}, false}); }
+      void Key(string key) override { stack_.back().key = move(key); }
+      void EndObject() override { Close(); }
+      void Bool(bool value) override { AddValue(Node(value)); }
+      void Int(int value) override { AddValue(Node(value)); }
+      void Double(double value) override { AddValue(Node(value)); }
+      void String(string value) override { AddValue(Node(move(value))); }
+
+    private:
+      struct Frame {
+        Node value;
+        string key;
+        bool streamed;
+      };
+
+      void Close() {
+        Node value = move(stack_.back().value);
+        stack_.pop_back();
+        AddValue(move(value));
+      }
+
+      void AddValue(Node value) {
+        if (stack_.empty()) {
+          root_ = move(value);
+          return;
+        }
+        Frame& top = stack_.back();
+        if (top.streamed) {
+          on_element_(move(value));
+        } else if (holds_alternative<vector<Node>>(top.value)) {
+          get<vector<Node>>(top.value).push_back(move(value));
+        } else {
+          get<Dict>(top.value).emplace(move(top.key), move(value));
+        }
       }
-      result.push_back(LoadNode(input));
+
+      string stream_key_;
+      function<void(Node)> on_element_;
+      vector<Frame> stack_;
+      optional<Node> root_;
+    };
+
+    void AppendUtf8(string& result, uint32_t code) {
+      if (code < 0x80) {
+        result.push_back(static_cast<char>(code));
+      } else if (code < 0x800) {
+        result.push_back(static_cast<char>(0xC0 | (code >> 6)));
+        result.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+      } else if (code < 0x10000) {
+        result.push_back(static_cast<char>(0xE0 | (code >> 12)));
+        result.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3F)));
+        result.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+      } else {
+        result.push_back(static_cast<char>(0xF0 | (code >> 18)));
+        result.push_back(static_cast<char>(0x80 | ((code >> 12) & 0x3F)));
+        result.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3F)));
+        result.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+      }
+    }
+
+    bool IsNumberChar(char c) {
+      return isdigit(static_cast<unsigned char>(c)) || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E';
     }
+  }
+
+  Parser::Parser(istream& input) : input_(input), buffer_(BUFFER_SIZE) {}
+
+  void Parser::Parse(Handler& handler) {
+    ParseValue(handler);
+  }
 
-    return Node(move(result));
+  bool Parser::Fill() {
+    input_.read(buffer_.data(), buffer_.size());
+    size_ = input_.gcount();
+    pos_ = 0;
+    return size_ > 0;
   }
 
-  Node LoadBool(istream& input) {
-    string s;
-    while (isalpha(input.peek())) {
-      s.push_back(input.get());
+  // '\0' means the end of input
+  char Parser::Peek() {
+    if (pos_ == size_ && !Fill()) {
+      return '\0';
     }
-    return Node(s == "true");
+    return buffer_[pos_];
   }
 
-  Node LoadNumber(istream& input) {
-    bool is_negative = false;
-    if (input.peek() == '-') {
-      is_negative = true;
-      input.get();
+  char Parser::Get() {
+    const char c = Peek();
+    if (c == '\0' && pos_ == size_) {
+      throw ParsingError("unexpected end of input");
     }
-    int int_part = 0;
-    while (isdigit(input.peek())) {
-      int_part *= 10;
-      int_part += input.get() - '0';
+    ++pos_;
+    return c;
+  }
+
+  void Parser::Expect(char c) {
+    if (Get() != c) {
+      throw ParsingError(string("expected '") + c + "'");
     }
-    if (input.peek() != '.') {
-      return Node(int_part * (is_negative ? -1 : 1));
+  }
+
+  void Parser::SkipSpaces() {
+    while (isspace(static_cast<unsigned char>(Peek()))) {
+      ++pos_;
     }
-    input.get();  // '.'
-    double result = int_part;
-    double frac_mult = 0.1;
-    while (isdigit(input.peek())) {
-      result += frac_mult * (input.get() - '0');
-      frac_mult /= 10;
+  }
+
+  void Parser::ParseValue(Handler& handler) {
+    SkipSpaces();
+    const char c = Peek();
+    if (c == '[') {
+      ParseArray(handler);
+    } else if (c == '{') {
+      ParseObject(handler);
+    } else if (c == '"') {
+      ++pos_;
+      handler.String(ParseString());
+    } else if (c == 't' || c == 'f' || c == 'n') {
+      ParseLiteral(handler);
+    } else {
+      ParseNumber(handler);
     }
-    return Node(result * (is_negative ? -1 : 1));
   }
 
-  Node LoadString(istream& input) {
-    string line;
-    getline(input, line, '"');
-    return Node(move(line));
+  void Parser::ParseArray(Handler& handler) {
+    Expect('[');
+    handler.StartArray();
+    SkipSpaces();
+    if (Peek() == ']') {
+      ++pos_;
+      handler.EndArray();
+      return;
+    }
+    while (true) {
+      ParseValue(handler);
+      SkipSpaces();
+      const char c = Get();
+      if (c == ']') {
+        break;
+      }
+      if (c != ',') {
+        throw ParsingError("expected ',' or ']' in array");
+      }
+    }
+    handler.EndArray();
   }
 
-  Node LoadDict(istream& input) {
-    Dict result;
+  void Parser::ParseObject(Handler& handler) {
+    Expect('{');
+    handler.StartObject();
+    SkipSpaces();
+    if (Peek() == '}') {
+      ++pos_;
+      handler.EndObject();
+      return;
+    }
+    while (true) {
+      SkipSpaces();
+      Expect('"');
+      handler.Key(ParseString());
+      SkipSpaces();
+      Expect(':');
+      ParseValue(handler);
+      SkipSpaces();
+      const char c = Get();
+      if (c == '}') {
+        break;
+      }
+      if (c != ',') {
+        throw ParsingError("expected ',' or '}' in object");
+      }
+    }
+    handler.EndObject();
+  }
 
-    for (char c; input >> c && c != '}'; ) {
-      if (c == ',') {
-        input >> c;
+  // Numbers without fraction and exponent are ints, as before,
+  // ones that do not fit into int become doubles
+  void Parser::ParseNumber(Handler& handler) {
+    char token[64];
+    size_t length = 0;
+    bool is_double = false;
+    while (IsNumberChar(Peek())) {
+      if (length == sizeof(token)) {
+        throw ParsingError("too long number");
       }
+      const char c = buffer_[pos_++];
+      is_double = is_double || c == '.' || c == 'e' || c == 'E';
+      token[length++] = c;
+    }
+    if (length == 0) {
+      throw ParsingError("unexpected character");
+    }
+    const char* end = token + length;
+    if (!is_double) {
+      int value = 0;
+      const auto [ptr, ec] = from_chars(token, end, value);
+      if (ec == errc() && ptr == end) {
+        handler.Int(value);
+        return;
+      }
+      if (ec != errc::result_out_of_range) {
+        throw ParsingError("invalid number " + string(token, length));
+      }
+    }
+    double value = 0;
+    const auto [ptr, ec] = from_chars(token, end, value);
+    if (ec != errc() || ptr != end) {
+      throw ParsingError("invalid number " + string(token, length));
+    }
+    handler.Double(value);
+  }
 
-      string key = LoadString(input).AsString();
-      input >> c;
-      result.emplace(move(key), LoadNode(input));
+  void Parser::ParseLiteral(Handler& handler) {
+    string word;
+    while (isalpha(static_cast<unsigned char>(Peek()))) {
+      word.push_back(buffer_[pos_++]);
+    }
+    if (word == "true" || word == "false") {
+      handler.Bool(word == "true");
+    } else {
+      throw ParsingError("unsupported literal " + word);
     }
+  }
 
-    return Node(move(result));
+  // Opening quote is already taken
+  string Parser::ParseString() {
+    string result;
+    while (true) {
+      if (pos_ == size_ && !Fill()) {
+        throw ParsingError("unterminated string");
+      }
+      const char* begin = buffer_.data() + pos_;
+      const char* end = buffer_.data() + size_;
+      const char* stop = begin;
+      while (stop != end && *stop != '"' && *stop != '\\') {
+        ++stop;
+      }
+      result.append(begin, stop);
+      pos_ += stop - begin;
+      if (stop == end) {
+        continue;
+      }
+      ++pos_;
+      if (*stop == '"') {
+        return result;
+      }
+      ParseEscape(result);
+    }
   }
 
-  Node LoadNode(istream& input) {
-    char c;
-    input >> c;
+  void Parser::ParseEscape(string& result) {
+    const char c = Get();
+    switch (c) {
+    case '"':
+    case '\\':
+    case '/':
+      result.push_back(c);
+      break;
+    case 'b':
+      result.push_back('\b');
+      break;
+    case 'f':
+      result.push_back('\f');
+      break;
+    case 'n':
+      result.push_back('\n');
+      break;
+    case 'r':
+      result.push_back('\r');
+      break;
+    case 't':
+      result.push_back('\t');
+      break;
+    case 'u': {
+      uint32_t code = ParseHex4();
+      if (code >= 0xD800 && code < 0xDC00) {
+        Expect('\\');
+        Expect('u');
+        const uint32_t low = ParseHex4();
+        if (low < 0xDC00 || low >= 0xE000) {
+          throw ParsingError("invalid surrogate pair");
+        }
+        code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+      }
+      AppendUtf8(result, code);
+      break;
+    }
+    default:
+      throw ParsingError(string("invalid escape \\") + c);
+    }
+  }
 
-    if (c == '[') {
-      return LoadArray(input);
-    } else if (c == '{') {
-      return LoadDict(input);
-    } else if (c == '"') {
-      return LoadString(input);
-    } else if (c == 't' || c == 'f') {
-      input.putback(c);
-      return LoadBool(input);
-    } else {
-      input.putback(c);
-      return LoadNumber(input);
+  uint32_t Parser::ParseHex4() {
+    uint32_t code = 0;
+    for (int i = 0; i < 4; ++i) {
+      const char c = Get();
+      code <<= 4;
+      if (c >= '0' && c <= '9') {
+        code |= c - '0';
+      } else if (c >= 'a' && c <= 'f') {
+        code |= c - 'a' + 10;
+      } else if (c >= 'A' && c <= 'F') {
+        code |= c - 'A' + 10;
+      } else {
+        throw ParsingError("invalid \\u escape");
+      }
     }
+    return code;
+  }
+
+  Node LoadNode(istream& input) {
+    DocumentBuilder builder;
+    Parser(input).Parse(builder);
+    return builder.TakeRoot();
   }
 
   Document Load(istream& input) {
     return Document{LoadNode(input)};
   }
 
+  Document Load(istream& input, const string& stream_key, const function<void(Node)>& on_element) {
+    DocumentBuilder builder(stream_key, on_element);
+    Parser(input).Parse(builder);
+    return Document{builder.TakeRoot()};
+  }
+
   template <>
   void PrintValue<string>(const string& value, ostream& output) {
     output << '"' << value << '"';
@@ -1,7 +1,10 @@
 #pragma once
 
+#include <cstdint>
+#include <functional>
 #include <iostream>
 #include <map>
+#include <stdexcept>
 #include <string>
 #include <utility>
 #include <variant>
@@ -39,10 +42,68 @@ private:
   Node root;
 };
 
+class ParsingError : public std::runtime_error {
+public:
+  using runtime_error::runtime_error;
+};
+
+// SAX interface: parser reports values in document order
+// without building anything
+class Handler {
+public:
+  virtual ~Handler() = default;
+  virtual void StartArray() = 0;
+  virtual void EndArray() = 0;
+  virtual void StartObject() = 0;
+  virtual void Key(std::string key) = 0;
+  virtual void EndObject() = 0;
+  virtual void Bool(bool value) = 0;
+  virtual void Int(int value) = 0;
+  virtual void Double(double value) = 0;
+  virtual void String(std::string value) = 0;
+};
+
+// Reads input by blocks, so it may take more characters
+// from the stream than the parsed value has
+class Parser {
+public:
+  explicit Parser(std::istream &input);
+  // Parses one value, throws ParsingError on malformed input
+  void Parse(Handler &handler);
+
+private:
+  static constexpr size_t BUFFER_SIZE = 1 << 16;
+
+  bool Fill();
+  char Peek();
+  char Get();
+  void Expect(char c);
+  void SkipSpaces();
+
+  void ParseValue(Handler &handler);
+  void ParseArray(Handler &handler);
+  void ParseObject(Handler &handler);
+  void ParseNumber(Handler &handler);
+  void ParseLiteral(Handler &handler);
+  std::string ParseString();
+  void ParseEscape(std::string &result);
+  uint32_t ParseHex4();
+
+  std::istream &input_;
+  std::vector<char> buffer_;
+  size_t pos_ = 0;
+  size_t size_ = 0;
+};
+
 Node LoadNode(std::istream &input);
 
 Document Load(std::istream &input);
 
+// Elements of the array under stream_key of the root object are passed
+// to on_element as soon as they are parsed, document keeps it empty
+Document Load(std::istream &input, const std::string &stream_key,
+              const std::function<void(Node)> &on_element);
+
 void PrintNode(const Node &node, std::ostream &output);
 
 template<typename Value>
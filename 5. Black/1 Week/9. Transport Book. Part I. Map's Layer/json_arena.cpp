@@ -0,0 +1,376 @@
+#include "json_arena.h"
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+using namespace std;
+
+namespace Json {
+
+  namespace {
+    char* WriteUtf8(char* out, uint32_t code) {
+      if (code < 0x80) {
+        *out++ = static_cast<char>(code);
+      } else if (code < 0x800) {
+        *out++ = static_cast<char>(0xC0 | (code >> 6));
+        *out++ = static_cast<char>(0x80 | (code & 0x3F));
+      } else if (code < 0x10000) {
+        *out++ = static_cast<char>(0xE0 | (code >> 12));
+        *out++ = static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+        *out++ = static_cast<char>(0x80 | (code & 0x3F));
+      } else {
+        *out++ = static_cast<char>(0xF0 | (code >> 18));
+        *out++ = static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+        *out++ = static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+        *out++ = static_cast<char>(0x80 | (code & 0x3F));
+      }
+      return out;
+    }
+
+    bool IsNumberChar(char c) {
+      return isdigit(static_cast<unsigned char>(c)) || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E';
+    }
+
+    uint32_t CheckedSize(size_t size) {
+      if (size > numeric_limits<uint32_t>::max()) {
+        throw ParsingError("too large json value");
+      }
+      return static_cast<uint32_t>(size);
+    }
+  }
+
+  const ArenaMember* ArenaDict::find(string_view key) const {
+    const ArenaMember* it = lower_bound(begin(), end(), key, [](const ArenaMember& member, string_view key) {
+      return member.first < key;
+    });
+    return it != end() && it->first == key ? it : end();
+  }
+
+  const ArenaNode& ArenaDict::at(string_view key) const {
+    const ArenaMember* it = find(key);
+    if (it == end()) {
+      throw out_of_range("no key " + string(key) + " in json dict");
+    }
+    return it->second;
+  }
+
+  void ArenaNode::Check(Type type) const {
+    if (type_ != type) {
+      throw runtime_error("json node has another type");
+    }
+  }
+
+  ArenaArray ArenaNode::AsArray() const {
+    Check(Type::ARRAY);
+    return {items_, size_};
+  }
+
+  ArenaDict ArenaNode::AsMap() const {
+    Check(Type::DICT);
+    return {members_, size_};
+  }
+
+  bool ArenaNode::AsBool() const {
+    Check(Type::BOOL);
+    return bool_;
+  }
+
+  int ArenaNode::AsInt() const {
+    Check(Type::INT);
+    return int_;
+  }
+
+  double ArenaNode::AsDouble() const {
+    if (type_ == Type::INT) {
+      return int_;
+    }
+    Check(Type::DOUBLE);
+    return double_;
+  }
+
+  string_view ArenaNode::AsString() const {
+    Check(Type::STRING);
+    return {chars_, size_};
+  }
+
+  // Recursive descent over the text in memory. Children of open
+  // containers are collected on the stacks and copied to the arena
+  // when the container is closed
+  class ArenaDocument::Builder {
+  public:
+    Builder(char* begin, char* end, Arena& arena) : pos_(begin), end_(end), arena_(arena) {}
+
+    ArenaNode ParseValue() {
+      SkipSpaces();
+      if (pos_ == end_) {
+        throw ParsingError("unexpected end of input");
+      }
+      const char c = *pos_;
+      if (c == '[') {
+        return ParseArray();
+      } else if (c == '{') {
+        return ParseObject();
+      } else if (c == '"') {
+        ++pos_;
+        const string_view str = ParseString();
+        ArenaNode node;
+        node.type_ = ArenaNode::Type::STRING;
+        node.size_ = CheckedSize(str.size());
+        node.chars_ = str.data();
+        return node;
+      } else if (c == 't' || c == 'f' || c == 'n') {
+        return ParseLiteral();
+      } else {
+        return ParseNumber();
+      }
+    }
+
+  private:
+    char Get() {
+      if (pos_ == end_) {
+        throw ParsingError("unexpected end of input");
+      }
+      return *pos_++;
+    }
+
+    void Expect(char c) {
+      if (Get() != c) {
+        throw ParsingError(string("expected '") + c + "'");
+      }
+    }
+
+    void SkipSpaces() {
+      while (pos_ != end_ && isspace(static_cast<unsigned char>(*pos_))) {
+        ++pos_;
+      }
+    }
+
+    ArenaNode ParseArray() {
+      Expect('[');
+      const size_t first = items_.size();
+      SkipSpaces();
+      if (pos_ != end_ && *pos_ == ']') {
+        ++pos_;
+      } else {
+        while (true) {
+          items_.push_back(ParseValue());
+          SkipSpaces();
+          const char c = Get();
+          if (c == ']') {
+            break;
+          }
+          if (c != ',') {
+            throw ParsingError("expected ',' or ']' in array");
+          }
+        }
+      }
+      const size_t count = items_.size() - first;
+      ArenaNode* items = arena_.Allocate<ArenaNode>(count);
+      copy(items_.begin() + first, items_.end(), items);
+      items_.resize(first);
+
+      ArenaNode node;
+      node.type_ = ArenaNode::Type::ARRAY;
+      node.size_ = CheckedSize(count);
+      node.items_ = items;
+      return node;
+    }
+
+    ArenaNode ParseObject() {
+      Expect('{');
+      const size_t first = members_.size();
+      SkipSpaces();
+      if (pos_ != end_ && *pos_ == '}') {
+        ++pos_;
+      } else {
+        while (true) {
+          SkipSpaces();
+          Expect('"');
+          const string_view key = ParseString();
+          SkipSpaces();
+          Expect(':');
+          members_.push_back({key, ParseValue()});
+          SkipSpaces();
+          const char c = Get();
+          if (c == '}') {
+            break;
+          }
+          if (c != ',') {
+            throw ParsingError("expected ',' or '}' in object");
+          }
+        }
+      }
+      stable_sort(members_.begin() + first, members_.end(), [](const ArenaMember& lhs, const ArenaMember& rhs) {
+        return lhs.first < rhs.first;
+      });
+      const size_t count = members_.size() - first;
+      ArenaMember* members = arena_.Allocate<ArenaMember>(count);
+      copy(members_.begin() + first, members_.end(), members);
+      members_.resize(first);
+
+      ArenaNode node;
+      node.type_ = ArenaNode::Type::DICT;
+      node.size_ = CheckedSize(count);
+      node.members_ = members;
+      return node;
+    }
+
+    // Numbers without fraction and exponent are ints, as in Node
+    ArenaNode ParseNumber() {
+      char* begin = pos_;
+      bool is_double = false;
+      while (pos_ != end_ && IsNumberChar(*pos_)) {
+        is_double = is_double || *pos_ == '.' || *pos_ == 'e' || *pos_ == 'E';
+        ++pos_;
+      }
+      if (begin == pos_) {
+        throw ParsingError("unexpected character");
+      }
+      ArenaNode node;
+      if (!is_double) {
+        const auto [ptr, ec] = from_chars(begin, pos_, node.int_);
+        if (ec == errc() && ptr == pos_) {
+          node.type_ = ArenaNode::Type::INT;
+          return node;
+        }
+        if (ec != errc::result_out_of_range) {
+          throw ParsingError("invalid number " + string(begin, pos_));
+        }
+      }
+      const auto [ptr, ec] = from_chars(begin, pos_, node.double_);
+      if (ec != errc() || ptr != pos_) {
+        throw ParsingError("invalid number " + string(begin, pos_));
+      }
+      node.type_ = ArenaNode::Type::DOUBLE;
+      return node;
+    }
+
+    ArenaNode ParseLiteral() {
+      ArenaNode node;
+      node.type_ = ArenaNode::Type::BOOL;
+      if (end_ - pos_ >= 4 && memcmp(pos_, "true", 4) == 0) {
+        pos_ += 4;
+        node.bool_ = true;
+      } else if (end_ - pos_ >= 5 && memcmp(pos_, "false", 5) == 0) {
+        pos_ += 5;
+        node.bool_ = false;
+      } else {
+        throw ParsingError("unsupported literal");
+      }
+      return node;
+    }
+
+    // Opening quote is already taken. Decoded string is never
+    // longer than its escaped form, so it is written over it
+    string_view ParseString() {
+      char* begin = pos_;
+      char* stop = begin;
+      while (stop != end_ && *stop != '"' && *stop != '\\') {
+        ++stop;
+      }
+      if (stop == end_) {
+        throw ParsingError("unterminated string");
+      }
+      pos_ = stop + 1;
+      if (*stop == '"') {
+        return {begin, static_cast<size_t>(stop - begin)};
+      }
+      char* out = ParseEscape(stop);
+      while (true) {
+        const char c = Get();
+        if (c == '"') {
+          return {begin, static_cast<size_t>(out - begin)};
+        }
+        out = c == '\\' ? ParseEscape(out) : (*out = c, out + 1);
+      }
+    }
+
+    char* ParseEscape(char* out) {
+      const char c = Get();
+      switch (c) {
+      case '"':
+      case '\\':
+      case '/':
+        *out++ = c;
+        return out;
+      case 'b':
+        *out++ = '\b';
+        return out;
+      case 'f':
+        *out++ = '\f';
+        return out;
+      case 'n':
+        *out++ = '\n';
+        return out;
+      case 'r':
+        *out++ = '\r';
+        return out;
+      case 't':
+        *out++ = '\t';
+        return out;
+      case 'u': {
+        uint32_t code = ParseHex4();
+        if (code >= 0xD800 && code < 0xDC00) {
+          Expect('\\');
+          Expect('u');
+          const uint32_t low = ParseHex4();
+          if (low < 0xDC00 || low >= 0xE000) {
+            throw ParsingError("invalid surrogate pair");
+          }
+          code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+        }
+        return WriteUtf8(out, code);
+      }
+      default:
+        throw ParsingError(string("invalid escape \\") + c);
+      }
+    }
+
+    uint32_t ParseHex4() {
+      uint32_t code = 0;
+      for (int i = 0; i < 4; ++i) {
+        const char c = Get();
+        code <<= 4;
+        if (c >= '0' && c <= '9') {
+          code |= c - '0';
+        } else if (c >= 'a' && c <= 'f') {
+          code |= c - 'a' + 10;
+        } else if (c >= 'A' && c <= 'F') {
+          code |= c - 'A' + 10;
+        } else {
+          throw ParsingError("invalid \\u escape");
+        }
+      }
+      return code;
+    }
+
+    char* pos_;
+    char* end_;
+    Arena& arena_;
+    vector<ArenaNode> items_;
+    vector<ArenaMember> members_;
+  };
+
+  ArenaDocument::ArenaDocument(vector<char> text) : text_(move(text)) {
+    Builder builder(text_.data(), text_.data() + text_.size(), arena_);
+    root_ = builder.ParseValue();
+  }
+
+  ArenaDocument LoadArena(istream& input) {
+    vector<char> text(1 << 16);
+    size_t size = 0;
+    while (input.read(text.data() + size, text.size() - size), input.gcount() > 0) {
+      size += input.gcount();
+      if (size == text.size()) {
+        text.resize(size * 2);
+      }
+    }
+    text.resize(size);
+    return ArenaDocument(move(text));
+  }
+
+}
@@ -0,0 +1,151 @@
+#pragma once
+
+#include "json.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+namespace Json {
+
+// Memory for nodes of one document. Everything is freed at once
+// with the arena, so only trivially destructible types are stored
+class Arena {
+public:
+  Arena() = default;
+  Arena(const Arena &) = delete;
+  Arena &operator=(const Arena &) = delete;
+  Arena(Arena &&) = default;
+  Arena &operator=(Arena &&) = default;
+
+  template<typename T>
+  T *Allocate(size_t count);
+
+private:
+  static constexpr size_t BLOCK_SIZE = 1 << 16;
+
+  std::vector<std::unique_ptr<char[]>> blocks_;
+  char *current_ = nullptr;
+  size_t left_ = 0;
+};
+
+class ArenaArray;
+class ArenaDict;
+struct ArenaMember;
+
+// Read-only node with the same accessors as Node, but strings
+// are views into the document text and containers are flat arrays
+class ArenaNode {
+public:
+  enum class Type : uint8_t {ARRAY, DICT, BOOL, INT, DOUBLE, STRING};
+
+  Type GetType() const { return type_; }
+
+  ArenaArray AsArray() const;
+  ArenaDict AsMap() const;
+  bool AsBool() const;
+  int AsInt() const;
+  double AsDouble() const;
+  std::string_view AsString() const;
+
+private:
+  friend class ArenaDocument;
+
+  void Check(Type type) const;
+
+  Type type_ = Type::INT;
+  uint32_t size_ = 0;
+  union {
+    bool bool_;
+    int int_;
+    double double_;
+    const char *chars_;
+    const ArenaNode *items_;
+    const ArenaMember *members_;
+  };
+};
+
+struct ArenaMember {
+  std::string_view first;
+  ArenaNode second;
+};
+
+class ArenaArray {
+public:
+  ArenaArray(const ArenaNode *items, size_t size) : items_(items), size_(size) {}
+
+  const ArenaNode *begin() const { return items_; }
+  const ArenaNode *end() const { return items_ + size_; }
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  const ArenaNode &operator[](size_t idx) const { return items_[idx]; }
+
+private:
+  const ArenaNode *items_;
+  size_t size_;
+};
+
+// Members are sorted by key, the first one is kept for repeated keys
+class ArenaDict {
+public:
+  ArenaDict(const ArenaMember *members, size_t size) : members_(members), size_(size) {}
+
+  const ArenaMember *begin() const { return members_; }
+  const ArenaMember *end() const { return members_ + size_; }
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+  const ArenaMember *find(std::string_view key) const;
+  size_t count(std::string_view key) const { return find(key) != end(); }
+  // Throws std::out_of_range like std::map::at
+  const ArenaNode &at(std::string_view key) const;
+
+private:
+  const ArenaMember *members_;
+  size_t size_;
+};
+
+// Keeps the whole text of the document, strings without escapes
+// point right into it, escaped ones are decoded in place
+class ArenaDocument {
+public:
+  explicit ArenaDocument(std::vector<char> text);
+
+  const ArenaNode &GetRoot() const {
+    return root_;
+  }
+
+private:
+  class Builder;
+
+  std::vector<char> text_;
+  Arena arena_;
+  ArenaNode root_;
+};
+
+ArenaDocument LoadArena(std::istream &input);
+
+
+template<typename T>
+T *Arena::Allocate(size_t count) {
+  static_assert(std::is_trivially_destructible_v<T>, "arena does not call destructors");
+  const size_t bytes = count * sizeof(T);
+  const size_t padding = (alignof(T) - reinterpret_cast<uintptr_t>(current_) % alignof(T)) % alignof(T);
+  if (current_ == nullptr || padding + bytes > left_) {
+    const size_t block_size = std::max(BLOCK_SIZE, bytes);
+    blocks_.push_back(std::make_unique<char[]>(block_size));
+    current_ = blocks_.back().get();
+    left_ = block_size;
+    return Allocate<T>(count);
+  }
+  T *result = reinterpret_cast<T *>(current_ + padding);
+  current_ += padding + bytes;
+  left_ -= padding + bytes;
+  return result;
+}
+
+}
@@ -0,0 +1,214 @@
+#include "json_writer.h"
+
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+
+using namespace std;
+
+namespace Json {
+
+  namespace {
+    constexpr uint64_t ONES = 0x0101010101010101ULL;
+    constexpr uint64_t HIGH_BITS = 0x8080808080808080ULL;
+
+    // Marks bytes of the word which are zero (may also mark
+    // some bytes after a real one, which is enough for a check)
+    uint64_t ZeroBytes(uint64_t word) {
+      return (word - ONES) & ~word & HIGH_BITS;
+    }
+
+    // Eight characters at once: any quote, backslash or control character
+    bool NeedsEscape(uint64_t word) {
+      const uint64_t quotes = ZeroBytes(word ^ (ONES * '"'));
+      const uint64_t backslashes = ZeroBytes(word ^ (ONES * '\\'));
+      const uint64_t controls = (word - ONES * 0x20) & ~word & HIGH_BITS;
+      return (quotes | backslashes | controls) != 0;
+    }
+
+    bool NeedsEscape(char c) {
+      return c == '"' || c == '\\' || static_cast<unsigned char>(c) < 0x20;
+    }
+  }
+
+  Writer::Writer(ostream& out, optional<int> precision)
+      : out_(out), precision_(precision), buffer_(BUFFER_SIZE) {}
+
+  Writer::~Writer() {
+    Flush();
+  }
+
+  void Writer::Flush() {
+    out_.write(buffer_.data(), size_);
+    size_ = 0;
+  }
+
+  void Writer::Write(string_view str) {
+    if (size_ + str.size() > buffer_.size()) {
+      Flush();
+      if (str.size() > buffer_.size()) {
+        out_.write(str.data(), str.size());
+        return;
+      }
+    }
+    memcpy(buffer_.data() + size_, str.data(), str.size());
+    size_ += str.size();
+  }
+
+  void Writer::Write(char c) {
+    if (size_ == buffer_.size()) {
+      Flush();
+    }
+    buffer_[size_++] = c;
+  }
+
+  void Writer::BeginValue() {
+    if (after_key_) {
+      after_key_ = false;
+      return;
+    }
+    if (!first_.empty()) {
+      if (!first_.back()) {
+        Write(", ");
+      }
+      first_.back() = false;
+    }
+  }
+
+  Writer& Writer::StartArray() {
+    BeginValue();
+    Write('[');
+    first_.push_back(true);
+    return *this;
+  }
+
+  Writer& Writer::EndArray() {
+    first_.pop_back();
+    Write(']');
+    return *this;
+  }
+
+  Writer& Writer::StartObject() {
+    BeginValue();
+    Write('{');
+    first_.push_back(true);
+    return *this;
+  }
+
+  Writer& Writer::EndObject() {
+    first_.pop_back();
+    Write('}');
+    return *this;
+  }
+
+  Writer& Writer::Key(string_view key) {
+    BeginValue();
+    Write('"');
+    WriteEscaped(key);
+    Write("\": ");
+    after_key_ = true;
+    return *this;
+  }
+
+  Writer& Writer::Value(bool value) {
+    BeginValue();
+    Write(value ? "true" : "false");
+    return *this;
+  }
+
+  Writer& Writer::Value(int value) {
+    BeginValue();
+    char digits[16];
+    const auto result = to_chars(begin(digits), end(digits), value);
+    Write(string_view(digits, result.ptr - digits));
+    return *this;
+  }
+
+  Writer& Writer::Value(double value) {
+    BeginValue();
+    char digits[64];
+    const auto result = precision_
+                        ? to_chars(begin(digits), end(digits), value, chars_format::general, *precision_)
+                        : to_chars(begin(digits), end(digits), value);
+    Write(string_view(digits, result.ptr - digits));
+    return *this;
+  }
+
+  Writer& Writer::Value(string_view value) {
+    BeginValue();
+    Write('"');
+    WriteEscaped(value);
+    Write('"');
+    return *this;
+  }
+
+  Writer& Writer::RawString(string_view value) {
+    BeginValue();
+    Write('"');
+    Write(value);
+    Write('"');
+    return *this;
+  }
+
+  Writer& Writer::RawValue(string_view json) {
+    BeginValue();
+    Write(json);
+    return *this;
+  }
+
+  // Clean runs are found by words and copied as a whole
+  void Writer::WriteEscaped(string_view str) {
+    size_t run_begin = 0;
+    size_t pos = 0;
+    while (pos < str.size()) {
+      if (pos + sizeof(uint64_t) <= str.size()) {
+        uint64_t word;
+        memcpy(&word, str.data() + pos, sizeof(word));
+        if (!NeedsEscape(word)) {
+          pos += sizeof(word);
+          continue;
+        }
+      }
+      const size_t word_end = min(pos + sizeof(uint64_t), str.size());
+      for (; pos < word_end; ++pos) {
+        const char c = str[pos];
+        if (!NeedsEscape(c)) {
+          continue;
+        }
+        Write(str.substr(run_begin, pos - run_begin));
+        run_begin = pos + 1;
+        switch (c) {
+        case '"':
+          Write("\\\"");
+          break;
+        case '\\':
+          Write("\\\\");
+          break;
+        case '\n':
+          Write("\\n");
+          break;
+        case '\r':
+          Write("\\r");
+          break;
+        case '\t':
+          Write("\\t");
+          break;
+        case '\b':
+          Write("\\b");
+          break;
+        case '\f':
+          Write("\\f");
+          break;
+        default: {
+          const char hex[] = "0123456789abcdef";
+          const char escaped[] = {'\\', 'u', '0', '0',
+                                  hex[static_cast<unsigned char>(c) >> 4], hex[c & 0xF]};
+          Write(string_view(escaped, sizeof(escaped)));
+        }
+        }
+      }
+    }
+    Write(str.substr(run_begin));
+  }
+
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <iostream>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+namespace Json {
+
+// Writes JSON straight to the stream through its own buffer.
+// Separators are the same as in PrintNode, keys are written
+// in the order they are given
+class Writer {
+public:
+  // Without precision doubles are written in the shortest form
+  // that reads back to the same value, otherwise as with %g
+  explicit Writer(std::ostream &out, std::optional<int> precision = std::nullopt);
+  Writer(const Writer &) = delete;
+  Writer &operator=(const Writer &) = delete;
+  ~Writer();
+
+  Writer &StartArray();
+  Writer &EndArray();
+  Writer &StartObject();
+  Writer &EndObject();
+  Writer &Key(std::string_view key);
+
+  Writer &Value(bool value);
+  Writer &Value(int value);
+  Writer &Value(double value);
+  Writer &Value(std::string_view value);
+  Writer &Value(const char *value) { return Value(std::string_view(value)); }
+  // String which is already escaped, only quotes are added
+  Writer &RawString(std::string_view value);
+  // Complete JSON value written by another writer
+  Writer &RawValue(std::string_view json);
+
+  void Flush();
+
+private:
+  static constexpr size_t BUFFER_SIZE = 1 << 16;
+
+  void BeginValue();
+  void Write(std::string_view str);
+  void Write(char c);
+  void WriteEscaped(std::string_view str);
+
+  std::ostream &out_;
+  std::optional<int> precision_;
+  std::vector<char> buffer_;
+  size_t size_ = 0;
+  // For every open container: nothing is written into it yet
+  std::vector<bool> first_;
+  bool after_key_ = false;
+};
+
+}
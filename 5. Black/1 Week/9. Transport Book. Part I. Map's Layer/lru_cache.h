@@ -0,0 +1,113 @@
+//
+// Created by ilya on 04.06.2020.
+//
+
+#ifndef YANDEXCPLUSPLUS_5_BLACK_1_WEEK_9_TRANSPORT_BOOK_PART_I_LRU_CACHE_H
+#define YANDEXCPLUSPLUS_5_BLACK_1_WEEK_9_TRANSPORT_BOOK_PART_I_LRU_CACHE_H
+
+#include <functional>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <utility>
+
+namespace TransportDatabase {
+struct CacheStats {
+  size_t hits = 0;
+  size_t misses = 0;
+  size_t size = 0;
+};
+
+// Keeps at most capacity values, the least recently used one is
+// dropped first. Can be used from several threads at once.
+// Values are copied out, so keep them small or in shared_ptr
+template<typename Key, typename Value, typename Hash = std::hash<Key>>
+class LruCache {
+public:
+  // capacity = 0 turns cache off
+  explicit LruCache(size_t capacity = 0) : capacity_(capacity) {}
+
+  void SetCapacity(size_t capacity);
+  // Counts hit or miss
+  std::optional<Value> Find(const Key &key);
+  void Put(const Key &key, Value value);
+  // Counters are kept
+  void Clear();
+  CacheStats GetStats() const;
+
+private:
+  using Item = std::pair<Key, Value>;
+
+  void Shrink();
+
+  mutable std::mutex mutex_;
+  size_t capacity_;
+  // The most recently used go first
+  std::list<Item> items_;
+  std::unordered_map<Key, typename std::list<Item>::iterator, Hash> positions_;
+  size_t hits_ = 0;
+  size_t misses_ = 0;
+};
+
+
+template<typename Key, typename Value, typename Hash>
+void LruCache<Key, Value, Hash>::SetCapacity(size_t capacity) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  capacity_ = capacity;
+  Shrink();
+}
+
+template<typename Key, typename Value, typename Hash>
+std::optional<Value> LruCache<Key, Value, Hash>::Find(const Key &key) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = positions_.find(key);
+  if (it == positions_.end()) {
+    ++misses_;
+    return std::nullopt;
+  }
+  ++hits_;
+  items_.splice(items_.begin(), items_, it->second);
+  return it->second->second;
+}
+
+template<typename Key, typename Value, typename Hash>
+void LruCache<Key, Value, Hash>::Put(const Key &key, Value value) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (capacity_ == 0) {
+    return;
+  }
+  auto it = positions_.find(key);
+  if (it != positions_.end()) {
+    it->second->second = std::move(value);
+    items_.splice(items_.begin(), items_, it->second);
+    return;
+  }
+  items_.emplace_front(key, std::move(value));
+  positions_.emplace(key, items_.begin());
+  Shrink();
+}
+
+template<typename Key, typename Value, typename Hash>
+void LruCache<Key, Value, Hash>::Clear() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  items_.clear();
+  positions_.clear();
+}
+
+template<typename Key, typename Value, typename Hash>
+CacheStats LruCache<Key, Value, Hash>::GetStats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return {hits_, misses_, items_.size()};
+}
+
+template<typename Key, typename Value, typename Hash>
+void LruCache<Key, Value, Hash>::Shrink() {
+  while (items_.size() > capacity_) {
+    positions_.erase(items_.back().first);
+    items_.pop_back();
+  }
+}
+}
+
+#endif //YANDEXCPLUSPLUS_5_BLACK_1_WEEK_9_TRANSPORT_BOOK_PART_I_LRU_CACHE_H
@@ -2,14 +2,42 @@
 // Created by ilya on 25.11.2019.
 //
 #include "manager.h"
-#include "json.h"
+#include "json_writer.h"
 
-int main() {
+#include <cstdlib>
+#include <fstream>
+#include <string_view>
+
+// Without arguments processes all requests at once, otherwise
+// make_base saves the base and process_requests answers with the saved one.
+// TRANSPORT_METRICS=stderr or a file name turns on timings of requests,
+// they are written there as JSON at the end
+int main(int argc, const char* argv[]) {
   TransportDatabase::DatabaseManager dm;
-  std::cout.precision(6);
-  auto result = dm.ProcessAllJSONRequests();
-  Json::PrintNode(result, std::cout);
+  const char* metrics_target = std::getenv("TRANSPORT_METRICS");
+  if (metrics_target) {
+    dm.EnableMetrics();
+  }
+  const std::string_view mode = argc > 1 ? argv[1] : "";
+  if (mode == "make_base") {
+    dm.MakeBase();
+  } else {
+    Json::Writer out(std::cout);
+    if (mode == "process_requests") {
+      dm.ProcessRequests(out);
+    } else {
+      dm.ProcessAllJSONRequests(out);
+    }
+  }
+  if (metrics_target) {
+    if (std::string_view(metrics_target) == "stderr") {
+      dm.WriteMetrics(std::cerr);
+      std::cerr << std::endl;
+    } else {
+      std::ofstream metrics_out(metrics_target);
+      dm.WriteMetrics(metrics_out);
+      metrics_out << std::endl;
+    }
+  }
   return 0;
 }
-
-
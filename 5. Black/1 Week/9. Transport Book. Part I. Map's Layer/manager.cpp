@@ -2,8 +2,11 @@
 // Created by ilya on 28.11.2019.
 //
 
+#include <cstring>
+#include <fstream>
 #include <sstream>
 #include "manager.h"
+#include "executor.h"
 
 namespace TransportDatabase {
 DatabaseManager::DatabaseManager() : router(nullptr) {
@@ -18,37 +21,176 @@ void DatabaseManager::ChangeDatabase(std::shared_ptr<Database> db) {
   db_ = std::move(db);
 }
 
-Json::Node DatabaseManager::ProcessAllJSONRequests(std::istream &in) {
-  auto doc = Json::Load(in);
-  auto global_type_map = doc.GetRoot().AsMap();
-  const std::string modify_type = "base_requests";
-  Json::Node modify_requests = global_type_map.at(modify_type);
+void DatabaseManager::ChangeRouter(std::shared_ptr<Router> new_router) {
+  router = std::move(new_router);
+}
+
+void DatabaseManager::ChangeMap(std::shared_ptr<Map> new_render) {
+  render = std::move(new_render);
+}
+
+void DatabaseManager::EnableMetrics(bool enabled) {
+  metrics.Enable(enabled);
+}
+
+void DatabaseManager::WriteMetrics(std::ostream &out) const {
+  Json::Writer writer(out);
+  metrics.WriteJSON(writer);
+}
+
+void DatabaseManager::ProcessAllJSONRequests(Json::Writer &out, std::istream &in) {
+  auto doc = LoadWithBaseRequests(in);
+  const auto &global_type_map = doc.GetRoot().AsMap();
   const std::string params_type = "routing_settings";
   Json::Node params_request = global_type_map.at(params_type);
-  for (const auto &node : modify_requests.AsArray()) {
-    ProcessJSONModifyRequest(node);
-  }
-  RoutingParam rp = {params_request.AsMap().at("bus_velocity").AsDouble(),
-                     params_request.AsMap().at("bus_wait_time").AsDouble()};
-  router = std::make_shared<Router>(Router{db_, rp});
+  RoutingParam rp = ExtractRoutingParams(params_request);
+  BuildRouter(rp);
 
   const std::string render_type = "render_settings";
   Json::Node render_requests = global_type_map.at(render_type);
   RenderParams params = ExtractRenderParams(render_requests);
-  render = std::make_shared<Map>(Map(db_, params));
+  BuildMap(params);
 
   const std::string read_type = "stat_requests";
-  Json::Node read_requests = global_type_map.at(read_type);
+  ProcessStatRequests(global_type_map.at(read_type), out);
+}
+
+namespace {
+const char BASE_MAGIC[8] = {'T', 'R', 'N', 'S', 'B', 'A', 'S', 'E'};
+const uint32_t BASE_VERSION = 5;
+
+std::string SettingsToString(const Json::Node &node) {
+  std::ostringstream out;
+  out.precision(17);
+  Json::PrintNode(node, out);
+  return out.str();
+}
+
+Json::Node SettingsFromString(const std::string &str) {
+  std::istringstream in(str);
+  return Json::Load(in).GetRoot();
+}
+}
+
+void DatabaseManager::MakeBase(std::istream &in) {
+  auto doc = LoadWithBaseRequests(in);
+  const auto &global_type_map = doc.GetRoot().AsMap();
+  const Json::Node &params_request = global_type_map.at("routing_settings");
+  RoutingParam rp = ExtractRoutingParams(params_request);
+  if (rp.router_type == RouterType::ALL_PAIRS || rp.router_type == RouterType::COMPACT_ALL_PAIRS) {
+    // Tiled table keeps full weights and can be mapped from the file
+    rp.router_type = RouterType::TILED_ALL_PAIRS;
+  }
+  BuildRouter(rp);
 
-  std::vector<Json::Node> result;
-  for (const auto &node : read_requests.AsArray()) {
-    result.push_back(ProcessJSONReadRequest(node));
+  MetricsTimer timer(metrics, "serialize");
+  std::ofstream out(ExtractBaseFile(doc.GetRoot()), std::ios::binary);
+  out.write(BASE_MAGIC, sizeof(BASE_MAGIC));
+  Serialization::Serialize(BASE_VERSION, out);
+  Serialization::Serialize(SettingsToString(global_type_map.at("render_settings")), out);
+  db_->Serialize(out);
+  router->Serialize(out);
+  if (!out) {
+    throw std::runtime_error("can not write base file");
+  }
+}
+
+// Stat requests are read into the arena DOM, it is freed at once with the document
+void DatabaseManager::ProcessRequests(Json::Writer &out, std::istream &in) {
+  auto doc = Json::LoadArena(in);
+  router.reset();
+  base_file = std::make_shared<Serialization::MappedFile>(ExtractBaseFile(doc.GetRoot()));
+  auto reader = base_file->MakeReader();
+  if (std::memcmp(reader.Take(sizeof(BASE_MAGIC)), BASE_MAGIC, sizeof(BASE_MAGIC)) != 0) {
+    throw std::runtime_error("file is not a transport database base");
+  }
+  uint32_t version = 0;
+  Serialization::Deserialize(reader, version);
+  if (version != BASE_VERSION) {
+    throw std::runtime_error("unsupported base version " + std::to_string(version));
   }
-  return Json::Node(result);
+  std::string render_settings;
+  Serialization::Deserialize(reader, render_settings);
+  {
+    MetricsTimer timer(metrics, "deserialize");
+    db_ = std::make_shared<Database>();
+    db_->Deserialize(reader);
+    router = std::make_shared<Router>(db_, reader);
+  }
+  BuildMap(ExtractRenderParams(SettingsFromString(render_settings)));
+  ProcessStatRequests(doc.GetRoot().AsMap().at("stat_requests"), out);
+}
+
+// Base requests are processed while the rest of input is being read
+Json::Document DatabaseManager::LoadWithBaseRequests(std::istream &in) {
+  auto doc = [this, &in] {
+    MetricsTimer timer(metrics, "base_requests");
+    return Json::Load(in, "base_requests", [this](Json::Node request) {
+      ProcessJSONModifyRequest(request);
+    });
+  }();
+  MetricsTimer timer(metrics, "freeze");
+  db_->Freeze();
+  return doc;
 }
 
+void DatabaseManager::BuildRouter(const RoutingParam &rp) {
+  {
+    MetricsTimer timer(metrics, "router_build");
+    router = std::make_shared<Router>(db_, rp);
+  }
+  if (metrics.IsEnabled()) {
+    const BuildStats stats = router->GetBuildStats();
+    metrics.AddPhase("router_build.graph", stats.graph);
+    metrics.AddPhase("router_build.router", stats.router);
+  }
+}
+
+void DatabaseManager::BuildMap(const RenderParams &params) {
+  MetricsTimer timer(metrics, "map_build");
+  render = std::make_shared<Map>(db_, params);
+}
+
+// Stat requests only read the base, so they are answered in parallel.
+// Every thread writes answers into its own buffer, then they are
+// copied to out in the order of requests
+template<typename NodeType>
+void DatabaseManager::ProcessStatRequests(const NodeType &node, Json::Writer &out) {
+  MetricsTimer timer(metrics, "stat_requests");
+  const auto &requests_json = node.AsArray();
+  std::vector<RequestHolder> requests;
+  requests.reserve(requests_json.size());
+  for (const auto &request : requests_json) {
+    requests.push_back(ParseReadJSONRequest(request));
+  }
+  std::vector<std::string> answers(requests.size());
+  ParallelFor(requests.size(), [this, &requests, &answers](size_t idx) {
+    thread_local std::ostringstream answer_out;
+    thread_local Json::Writer answer_writer(answer_out);
+    WriteJSONAnswer(std::move(requests[idx]), answer_writer);
+    answer_writer.Flush();
+    answers[idx] = answer_out.str();
+    answer_out.str({});
+  }, thread_count);
+  out.StartArray();
+  for (const auto &answer : answers) {
+    out.RawValue(answer);
+  }
+  out.EndArray();
+}
+
+template<typename NodeType>
+std::string DatabaseManager::ExtractBaseFile(const NodeType &node) {
+  return std::string(node.AsMap().at("serialization_settings").AsMap().at("file").AsString());
+}
+
+// Graph is built after base requests, later changes are appended to it
 Json::Node DatabaseManager::ProcessJSONModifyRequest(const Json::Node &node) {
-  return MakeJSONAnswerFromAnyRequest(ParseModifyJSONRequest(node));
+  auto answer = MakeJSONAnswerFromAnyRequest(ParseModifyJSONRequest(node));
+  if (router) {
+    router->UpdateGraph();
+  }
+  return answer;
 }
 
 Json::Node DatabaseManager::ProcessJSONReadRequest(const Json::Node &node) {
@@ -56,6 +198,7 @@ Json::Node DatabaseManager::ProcessJSONReadRequest(const Json::Node &node) {
 }
 
 Json::Node DatabaseManager::MakeJSONAnswerFromAnyRequest(RequestHolder request) {
+  MetricsTimer timer(metrics, request->GetType());
   switch (request->GetType()) {
   case Request::Type::ADD_STOP: {
     const auto &cast_request = dynamic_cast<ModifyRequest<Database> &>(*request);
@@ -87,10 +230,62 @@ Json::Node DatabaseManager::MakeJSONAnswerFromAnyRequest(RequestHolder request)
     const auto result = cast_request.Process(*render);
     return cast_request.JSONAnswer(result);
   }
+  case Request::Type::NEAREST_STOPS:
+  case Request::Type::STOPS_IN_RADIUS:
+  case Request::Type::STOPS_IN_BOX: {
+    const auto &cast_request = dynamic_cast<ReadRequest<FindStopsAnswer, Database> &>(*request);
+    const auto result = cast_request.Process(*db_);
+    return cast_request.JSONAnswer(result);
+  }
+  case Request::Type::ROUTE_MATRIX: {
+    const auto &cast_request = dynamic_cast<ReadRequest<RouteMatrixAnswer, Router> &>(*request);
+    const auto result = cast_request.Process(*router);
+    return cast_request.JSONAnswer(result);
+  }
   default:return Json::Node("error");
   }
 }
 
+namespace {
+template<typename Answer, typename Processor>
+void WriteReadAnswer(const Request &request, Processor &processor, Json::Writer &out) {
+  const auto &cast_request = dynamic_cast<const ReadRequest<Answer, Processor> &>(request);
+  cast_request.WriteAnswer(cast_request.Process(processor), out);
+}
+}
+
+void DatabaseManager::WriteJSONAnswer(RequestHolder request, Json::Writer &out) {
+  if (!request) {
+    out.Value("error");
+    return;
+  }
+  MetricsTimer timer(metrics, request->GetType());
+  switch (request->GetType()) {
+  case Request::Type::TAKE_ROUTE:
+    WriteReadAnswer<TakeRouteAnswer>(*request, *db_, out);
+    break;
+  case Request::Type::TAKE_STOP:
+    WriteReadAnswer<TakeStopAnswer>(*request, *db_, out);
+    break;
+  case Request::Type::CREATE_ROUTE:
+    WriteReadAnswer<CreateRouteAnswer>(*request, *router, out);
+    break;
+  case Request::Type::CREATE_MAP:
+    WriteReadAnswer<CreateMapAnswer>(*request, *render, out);
+    break;
+  case Request::Type::NEAREST_STOPS:
+  case Request::Type::STOPS_IN_RADIUS:
+  case Request::Type::STOPS_IN_BOX:
+    WriteReadAnswer<FindStopsAnswer>(*request, *db_, out);
+    break;
+  case Request::Type::ROUTE_MATRIX:
+    WriteReadAnswer<RouteMatrixAnswer>(*request, *router, out);
+    break;
+  default:
+    out.Value("error");
+  }
+}
+
 RequestHolder DatabaseManager::ParseModifyJSONRequest(const Json::Node &node) {
   auto type = node.AsMap().at("type").AsString();
   if (type == "Stop") {
@@ -102,7 +297,8 @@ RequestHolder DatabaseManager::ParseModifyJSONRequest(const Json::Node &node) {
   }
 }
 
-RequestHolder DatabaseManager::ParseReadJSONRequest(const Json::Node &node) {
+template<typename NodeType>
+RequestHolder DatabaseManager::ParseReadJSONRequest(const NodeType &node) {
   auto type = node.AsMap().at("type").AsString();
   if (type == "Stop") {
     return JSONRequest(Request::Type::TAKE_STOP, node);
@@ -112,13 +308,21 @@ RequestHolder DatabaseManager::ParseReadJSONRequest(const Json::Node &node) {
     return JSONRequest(Request::Type::CREATE_ROUTE, node);
   } else if (type == "Map") {
     return JSONRequest(Request::Type::CREATE_MAP, node);
+  } else if (type == "RouteMatrix") {
+    return JSONRequest(Request::Type::ROUTE_MATRIX, node);
+  } else if (type == "NearestStops") {
+    return JSONRequest(Request::Type::NEAREST_STOPS, node);
+  } else if (type == "StopsInRadius") {
+    return JSONRequest(Request::Type::STOPS_IN_RADIUS, node);
+  } else if (type == "StopsInBox") {
+    return JSONRequest(Request::Type::STOPS_IN_BOX, node);
   } else {
     return nullptr;
   }
 }
 
-template<typename RequestType>
-RequestHolder DatabaseManager::JSONRequest(RequestType type, const Json::Node &node) {
+template<typename RequestType, typename NodeType>
+RequestHolder DatabaseManager::JSONRequest(RequestType type, const NodeType &node) {
   auto request_ptr = Request::Create(type);
   if (request_ptr) {
     request_ptr->ParseFromJSON(node);
@@ -126,6 +330,39 @@ RequestHolder DatabaseManager::JSONRequest(RequestType type, const Json::Node &n
   return request_ptr;
 }
 
+RouterType RouterMapping(const std::string& str) {
+  if (str == "all_pairs") return RouterType::ALL_PAIRS;
+  if (str == "tiled_all_pairs") return RouterType::TILED_ALL_PAIRS;
+  if (str == "compact_all_pairs") return RouterType::COMPACT_ALL_PAIRS;
+  if (str == "dijkstra") return RouterType::DIJKSTRA;
+  if (str == "contraction_hierarchy") return RouterType::CONTRACTION_HIERARCHY;
+  std::string error_msg = str + "is unknown router type";
+  throw std::runtime_error(error_msg);
+}
+
+GraphType GraphMapping(const std::string& str) {
+  if (str == "stop_to_stop") return GraphType::STOP_TO_STOP;
+  if (str == "ride_vertices") return GraphType::RIDE_VERTICES;
+  std::string error_msg = str + "is unknown route graph type";
+  throw std::runtime_error(error_msg);
+}
+
+RoutingParam DatabaseManager::ExtractRoutingParams(const Json::Node &node) {
+  const auto& param_map = node.AsMap();
+  RoutingParam rp = {param_map.at("bus_velocity").AsDouble(),
+                     param_map.at("bus_wait_time").AsDouble()};
+  if (param_map.count("router")) {
+    rp.router_type = RouterMapping(param_map.at("router").AsString());
+  }
+  if (param_map.count("route_graph")) {
+    rp.graph_type = GraphMapping(param_map.at("route_graph").AsString());
+  }
+  if (param_map.count("route_cache_size")) {
+    rp.route_cache_size = param_map.at("route_cache_size").AsInt();
+  }
+  return rp;
+}
+
 Svg::Color GetColor(Json::Node node) {
   if (std::holds_alternative<std::string>(node)) {
     return node.AsString();
@@ -11,10 +11,14 @@
 #include <list>
 
 #include "json.h"
+#include "json_arena.h"
+#include "json_writer.h"
 #include "request.h"
 #include "database.h"
 #include "route.h"
 #include "map.h"
+#include "metrics.h"
+#include "serialization.h"
 
 namespace TransportDatabase {
 void PrintResults(const std::vector<std::string> &results, std::ostream &out = std::cout);
@@ -23,23 +27,55 @@ public:
   DatabaseManager();
   explicit DatabaseManager(std::shared_ptr<Database> db);
   void ChangeDatabase(std::shared_ptr<Database> db);
-  Json::Node ProcessAllJSONRequests(std::istream &in = std::cin);
+  // Router and map answer stat requests given one by one
+  void ChangeRouter(std::shared_ptr<Router> new_router);
+  void ChangeMap(std::shared_ptr<Map> new_render);
+  // Answers to stat requests are written to out as one array
+  void ProcessAllJSONRequests(Json::Writer &out, std::istream &in = std::cin);
+  // Builds database, graph and router from base requests and saves
+  // them to the file from serialization settings
+  void MakeBase(std::istream &in = std::cin);
+  // Answers stat requests with the base saved by MakeBase
+  void ProcessRequests(Json::Writer &out, std::istream &in = std::cin);
   Json::Node ProcessJSONReadRequest(const Json::Node &node);
   Json::Node ProcessJSONModifyRequest(const Json::Node &node);
-private:
 
+  RoutingParam ExtractRoutingParams(const Json::Node& node);
+  // Bounds of the map are taken from the current database
   RenderParams ExtractRenderParams(const Json::Node& node);
 
+  // Latencies of requests by type and durations of build phases,
+  // off by default
+  void EnableMetrics(bool enabled = true);
+  // Writes metrics collected so far as one JSON object
+  void WriteMetrics(std::ostream& out) const;
+private:
+  Json::Document LoadWithBaseRequests(std::istream& in);
+  void BuildRouter(const RoutingParam& rp);
+  void BuildMap(const RenderParams& params);
+  // Stat requests may come in both DOMs
+  template<typename NodeType>
+  void ProcessStatRequests(const NodeType& node, Json::Writer& out);
+  template<typename NodeType>
+  std::string ExtractBaseFile(const NodeType& node);
+
   Json::Node MakeJSONAnswerFromAnyRequest(RequestHolder request);
+  void WriteJSONAnswer(RequestHolder request, Json::Writer& out);
   RequestHolder ParseModifyJSONRequest(const Json::Node &node);
-  RequestHolder ParseReadJSONRequest(const Json::Node &node);
+  template<typename NodeType>
+  RequestHolder ParseReadJSONRequest(const NodeType &node);
 
-  template<typename RequestType>
-  RequestHolder JSONRequest(RequestType type, const Json::Node &node);
+  template<typename RequestType, typename NodeType>
+  RequestHolder JSONRequest(RequestType type, const NodeType &node);
 
   std::shared_ptr<Database> db_;
+  // Loaded router may use mapped tables, so it is declared after the file
+  std::shared_ptr<Serialization::MappedFile> base_file;
   std::shared_ptr<Router> router;
   std::shared_ptr<Map> render;
+  // Threads for stat requests, 0 means one per hardware core
+  size_t thread_count = 0;
+  Metrics metrics;
 };
 }
 #endif //YANDEXBROWNFINAL_4_BROWN_FINAL_PROJECT_PART_A_MANAGER_H
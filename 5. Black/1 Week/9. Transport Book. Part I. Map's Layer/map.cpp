@@ -2,7 +2,6 @@
 // Created by ilya on 06.01.2020.
 //
 
-#include <sstream>
 #include <utility>
 #include <map>
 
@@ -57,8 +56,8 @@ void Layer::Clear() {
 std::vector<Svg::SvgObjectHolder> BusLayer::CreateLayer(const TransportDatabase::Database &db) {
   std::vector<Svg::SvgObjectHolder> result;
   std::map<std::string, std::shared_ptr<Route>> sorted_routes;
-  for (const auto& [route_name, route_ptr] : db.TakeRoutes()) {
-    sorted_routes[route_name] = route_ptr;
+  for (const auto& route_ptr : db.TakeRoutes()) {
+    sorted_routes[route_ptr->GetName()] = route_ptr;
   }
   Svg::Polyline basic_line;
   basic_line.SetStrokeWidth(params.render_params.line_width);
@@ -67,19 +66,19 @@ std::vector<Svg::SvgObjectHolder> BusLayer::CreateLayer(const TransportDatabase:
   for (const auto& [route_name, route_ptr] : sorted_routes) {
     Svg::Polyline bus = basic_line;
     bus.SetStrokeColor(params.GetNewColor());
-    auto stops_name = route_ptr->GetStopsName();
+    const auto& stops = route_ptr->GetStops();
     if (route_ptr->route_type == Route::RouteTypes::LINEAR) {
-      for (auto i = stops_name.begin(); i != stops_name.end(); ++i) {
+      for (auto i = stops.begin(); i != stops.end(); ++i) {
         auto stop = db.TakeStop(*i);
         bus.AddPoint(params.ZoomIn(stop->GetCoord()));
       }
-      for (auto i = std::next(stops_name.rbegin()); i != stops_name.rend(); ++i) {
+      for (auto i = std::next(stops.rbegin()); i != stops.rend(); ++i) {
         auto stop = db.TakeStop(*i);
         bus.AddPoint(params.ZoomIn(stop->GetCoord()));
       }
     }
     if (route_ptr->route_type == Route::RouteTypes::CYCLE) {
-      for (auto i = stops_name.begin(); i != stops_name.end(); ++i) {
+      for (auto i = stops.begin(); i != stops.end(); ++i) {
         auto stop = db.TakeStop(*i);
         bus.AddPoint(params.ZoomIn(stop->GetCoord()));
       }
@@ -92,8 +91,8 @@ std::vector<Svg::SvgObjectHolder> BusLayer::CreateLayer(const TransportDatabase:
 std::vector<Svg::SvgObjectHolder> StopLayer::CreateLayer(const TransportDatabase::Database &db) {
   std::vector<Svg::SvgObjectHolder> result;
   std::map<std::string, std::shared_ptr<Stop>> sorted_stops;
-  for (const auto& [route_name, route_ptr] : db.TakeStops()) {
-    sorted_stops[route_name] = route_ptr;
+  for (const auto& stop_ptr : db.TakeStops()) {
+    sorted_stops[stop_ptr->GetName()] = stop_ptr;
   }
   Svg::Circle base_circle;
   base_circle.SetRadius(params.render_params.stop_radius);
@@ -109,8 +108,8 @@ std::vector<Svg::SvgObjectHolder> StopLayer::CreateLayer(const TransportDatabase
 std::vector<Svg::SvgObjectHolder> StopNameLayer::CreateLayer(const TransportDatabase::Database &db) {
   std::vector<Svg::SvgObjectHolder> result;
   std::map<std::string, std::shared_ptr<Stop>> sorted_stops;
-  for (const auto& [stop_name, stop_ptr] : db.TakeStops()) {
-    sorted_stops[stop_name] = stop_ptr;
+  for (const auto& stop_ptr : db.TakeStops()) {
+    sorted_stops[stop_ptr->GetName()] = stop_ptr;
   }
   Svg::Text base_text;
   base_text.SetOffset(params.render_params.stop_label_offset);
@@ -140,8 +139,8 @@ std::vector<Svg::SvgObjectHolder> StopNameLayer::CreateLayer(const TransportData
 std::vector<Svg::SvgObjectHolder> BusNameLayer::CreateLayer(const Database &db) {
   std::vector<Svg::SvgObjectHolder> result;
   std::map<std::string, std::shared_ptr<Route>> sorted_route;
-  for (const auto& [route_name, route_ptr] : db.TakeRoutes()) {
-    sorted_route[route_name] = route_ptr;
+  for (const auto& route_ptr : db.TakeRoutes()) {
+    sorted_route[route_ptr->GetName()] = route_ptr;
   }
   Svg::ExtendedText base_text;
   base_text.SetOffset(params.render_params.bus_label_offset);
@@ -160,7 +159,7 @@ std::vector<Svg::SvgObjectHolder> BusNameLayer::CreateLayer(const Database &db)
       Svg::ExtendedText name = text;
       Svg::ExtendedText podl_name = podl;
       name.SetFillColor(params.GetNewColor());
-      auto stop = db.TakeStop(route_ptr->GetStopsName().front());
+      auto stop = db.TakeStop(route_ptr->GetStops().front());
       name.SetData(route_name);
       name.SetPoint(params.ZoomIn(stop->GetCoord()));
       podl_name.SetData(route_name);
@@ -172,8 +171,8 @@ std::vector<Svg::SvgObjectHolder> BusNameLayer::CreateLayer(const Database &db)
       Svg::ExtendedText name = text;
       Svg::ExtendedText podl_name = podl;
       name.SetFillColor(params.GetNewColor());
-      auto first_stop = db.TakeStop(route_ptr->GetStopsName().front());
-      auto last_stop = db.TakeStop(route_ptr->GetStopsName().back());
+      auto first_stop = db.TakeStop(route_ptr->GetStops().front());
+      auto last_stop = db.TakeStop(route_ptr->GetStops().back());
       {
         name.SetData(route_name);
         name.SetPoint(params.ZoomIn(first_stop->GetCoord()));
@@ -200,8 +199,7 @@ Map::Map() {
 }
 
 Map::Map(std::shared_ptr<Database> db, const RenderParams& params) : Connector(std::move(db)) {
-  render_config = RenderConfig(params);
-  SetLayerOrder(render_config.render_params.layers_order);
+  ChangeRenderParams(params);
 }
 
 template <typename LayerType>
@@ -211,7 +209,9 @@ Map::LayerHolder Map::CreateLayer()  {
 
 void Map::SetLayerOrder(const std::vector<LayersType> &layers_order) {
   current_order = layers_order;
+  layers.clear();
   CreateLayerOrder();
+  ResetRenderedMap();
 }
 
 void Map::CreateMap() {
@@ -221,14 +221,43 @@ void Map::CreateMap() {
       doc.AddDocPart(std::move(object));
     }
   }
-  doc.Render(std::cerr);
 }
 
+// Svg is rendered already escaped for JSON, so answers copy it as is
 std::string Map::RenderMap() {
-  std::stringstream out;
+  std::string result;
+  if (rendered_map) {
+    result.reserve(rendered_map->size());
+  }
+  Svg::Output out(result);
   doc.Render(out);
   ClearMap();
-  return out.str();
+  return result;
+}
+
+std::shared_ptr<const std::string> Map::BuildMap() {
+  std::lock_guard<std::mutex> lock(map_mutex);
+  if (!rendered_map || rendered_version != db_->GetVersion()) {
+    CreateMap();
+    rendered_map = std::make_shared<const std::string>(RenderMap());
+    rendered_version = db_->GetVersion();
+  }
+  return rendered_map;
+}
+
+void Map::ResetRenderedMap() {
+  std::lock_guard<std::mutex> lock(map_mutex);
+  rendered_map.reset();
+}
+
+void Map::ChangeDatabase(std::shared_ptr<Database> db) {
+  Connector::ChangeDatabase(std::move(db));
+  ResetRenderedMap();
+}
+
+void Map::ChangeRenderParams(const RenderParams &params) {
+  render_config = RenderConfig(params);
+  SetLayerOrder(render_config.render_params.layers_order);
 }
 
 void Map::CreateLayerOrder() {
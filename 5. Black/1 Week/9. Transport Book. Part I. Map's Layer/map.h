@@ -5,6 +5,7 @@
 #ifndef YANDEXCPLUSPLUS_5_BLACK_1_WEEK_7_TRANSPORT_BOOK_PART_G_MAP_MAP_H
 #define YANDEXCPLUSPLUS_5_BLACK_1_WEEK_7_TRANSPORT_BOOK_PART_G_MAP_MAP_H
 #include <memory>
+#include <mutex>
 #include <string>
 
 #include "connector.h"
@@ -92,11 +93,21 @@ public:
   Map();
   Map(std::shared_ptr<Database> db, const RenderParams& params);
 
+  void ChangeDatabase(std::shared_ptr<Database> db) override;
+  void ChangeRenderParams(const RenderParams& params);
   void SetLayerOrder(const std::vector<LayersType>& layers);
   void CreateMap();
   std::string RenderMap();
   void ClearMap();
+  // Rendered map is kept until database or render params change,
+  // so repeated calls share one string. Safe to call from several threads
+  std::shared_ptr<const std::string> BuildMap();
 private:
+  void ResetRenderedMap();
+  // CreateMap fills the shared document
+  std::mutex map_mutex;
+  std::shared_ptr<const std::string> rendered_map;
+  uint64_t rendered_version = 0;
   void CreateLayerOrder();
   Svg::Document doc;
   std::vector<LayerHolder> layers;
@@ -0,0 +1,146 @@
+//
+// Created by ilya on 04.06.2020.
+//
+
+#include "metrics.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace TransportDatabase {
+namespace {
+const char *RequestTypeName(Request::Type type) {
+  switch (type) {
+  case Request::Type::ADD_ROUTE: return "AddBus";
+  case Request::Type::ADD_STOP: return "AddStop";
+  case Request::Type::TAKE_ROUTE: return "Bus";
+  case Request::Type::TAKE_STOP: return "Stop";
+  case Request::Type::CREATE_ROUTE: return "Route";
+  case Request::Type::CREATE_MAP: return "Map";
+  case Request::Type::ROUTE_MATRIX: return "RouteMatrix";
+  case Request::Type::NEAREST_STOPS: return "NearestStops";
+  case Request::Type::STOPS_IN_RADIUS: return "StopsInRadius";
+  case Request::Type::STOPS_IN_BOX: return "StopsInBox";
+  }
+  return "Unknown";
+}
+
+double Microseconds(std::chrono::nanoseconds duration) {
+  return duration.count() / 1000.0;
+}
+
+void WriteHistogram(const LatencyHistogram &histogram, Json::Writer &out) {
+  out.StartObject()
+      .Key("count").Value(static_cast<int>(histogram.Count()))
+      .Key("total_ms").Value(Microseconds(histogram.Total()) / 1000.0)
+      .Key("p50_us").Value(Microseconds(histogram.Quantile(0.5)))
+      .Key("p99_us").Value(Microseconds(histogram.Quantile(0.99)))
+      .Key("max_us").Value(Microseconds(histogram.Max()))
+      .EndObject();
+}
+}
+
+void LatencyHistogram::Add(std::chrono::nanoseconds duration) {
+  const uint64_t nanoseconds = std::max<int64_t>(duration.count(), 0);
+  buckets_[Bucket(nanoseconds)].fetch_add(1, std::memory_order_relaxed);
+  count_.fetch_add(1, std::memory_order_relaxed);
+  total_.fetch_add(nanoseconds, std::memory_order_relaxed);
+  uint64_t max = max_.load(std::memory_order_relaxed);
+  while (max < nanoseconds && !max_.compare_exchange_weak(max, nanoseconds, std::memory_order_relaxed)) {
+  }
+}
+
+uint64_t LatencyHistogram::Count() const {
+  return count_.load(std::memory_order_relaxed);
+}
+
+std::chrono::nanoseconds LatencyHistogram::Total() const {
+  return std::chrono::nanoseconds(total_.load(std::memory_order_relaxed));
+}
+
+std::chrono::nanoseconds LatencyHistogram::Max() const {
+  return std::chrono::nanoseconds(max_.load(std::memory_order_relaxed));
+}
+
+std::chrono::nanoseconds LatencyHistogram::Quantile(double q) const {
+  const uint64_t count = Count();
+  if (count == 0) {
+    return std::chrono::nanoseconds(0);
+  }
+  // Rank of the duration, from 1
+  const auto rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(q * count)));
+  uint64_t seen = 0;
+  for (size_t bucket = 0; bucket < BUCKET_COUNT; ++bucket) {
+    seen += buckets_[bucket].load(std::memory_order_relaxed);
+    if (seen >= rank) {
+      return std::min(Max(), std::chrono::nanoseconds(BucketUpperBound(bucket)));
+    }
+  }
+  return Max();
+}
+
+// Bucket of value with highest bit b is 4 * b plus next two bits,
+// values below 4 have buckets of their own
+size_t LatencyHistogram::Bucket(uint64_t nanoseconds) {
+  if (nanoseconds < SUB_BUCKETS) {
+    return nanoseconds;
+  }
+  size_t high_bit = 0;
+  while (nanoseconds >> (high_bit + 1)) {
+    ++high_bit;
+  }
+  return high_bit * SUB_BUCKETS + ((nanoseconds >> (high_bit - 2)) & (SUB_BUCKETS - 1));
+}
+
+uint64_t LatencyHistogram::BucketUpperBound(size_t bucket) {
+  if (bucket < SUB_BUCKETS) {
+    return bucket;
+  }
+  const size_t high_bit = bucket / SUB_BUCKETS;
+  const uint64_t next = (SUB_BUCKETS + bucket % SUB_BUCKETS + 1);
+  // The last buckets end above what uint64_t holds
+  if (high_bit >= 62) {
+    return UINT64_MAX;
+  }
+  return (next << (high_bit - 2)) - 1;
+}
+
+void Metrics::Enable(bool enabled) {
+  enabled_.store(enabled, std::memory_order_relaxed);
+}
+
+bool Metrics::IsEnabled() const {
+  return enabled_.load(std::memory_order_relaxed);
+}
+
+void Metrics::AddRequest(Request::Type type, Clock::duration duration) {
+  requests_[static_cast<size_t>(type)].Add(std::chrono::duration_cast<std::chrono::nanoseconds>(duration));
+}
+
+void Metrics::AddPhase(const std::string &name, Clock::duration duration) {
+  std::lock_guard<std::mutex> lock(phases_mutex_);
+  phases_[name].Add(std::chrono::duration_cast<std::chrono::nanoseconds>(duration));
+}
+
+void Metrics::WriteJSON(Json::Writer &out) const {
+  out.StartObject();
+  out.Key("requests").StartObject();
+  for (size_t type = 0; type < REQUEST_TYPE_COUNT; ++type) {
+    if (requests_[type].Count() > 0) {
+      out.Key(RequestTypeName(static_cast<Request::Type>(type)));
+      WriteHistogram(requests_[type], out);
+    }
+  }
+  out.EndObject();
+  out.Key("phases").StartObject();
+  {
+    std::lock_guard<std::mutex> lock(phases_mutex_);
+    for (const auto &[name, histogram] : phases_) {
+      out.Key(name);
+      WriteHistogram(histogram, out);
+    }
+  }
+  out.EndObject();
+  out.EndObject();
+}
+}
@@ -0,0 +1,109 @@
+//
+// Created by ilya on 04.06.2020.
+//
+
+#ifndef YANDEXCPLUSPLUS_5_BLACK_1_WEEK_9_TRANSPORT_BOOK_PART_I_METRICS_H
+#define YANDEXCPLUSPLUS_5_BLACK_1_WEEK_9_TRANSPORT_BOOK_PART_I_METRICS_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+
+#include "json_writer.h"
+#include "request.h"
+
+namespace TransportDatabase {
+// Durations split into buckets by powers of two of nanoseconds, four
+// buckets per power, so quantiles are at most 25 % above exact ones.
+// Can be updated from several threads at once
+class LatencyHistogram {
+public:
+  void Add(std::chrono::nanoseconds duration);
+
+  uint64_t Count() const;
+  std::chrono::nanoseconds Total() const;
+  std::chrono::nanoseconds Max() const;
+  // Upper bound of the bucket with q-th part of durations, not above max
+  std::chrono::nanoseconds Quantile(double q) const;
+
+private:
+  static constexpr size_t SUB_BUCKETS = 4;
+  static constexpr size_t BUCKET_COUNT = 64 * SUB_BUCKETS;
+
+  static size_t Bucket(uint64_t nanoseconds);
+  static uint64_t BucketUpperBound(size_t bucket);
+
+  std::array<std::atomic<uint64_t>, BUCKET_COUNT> buckets_{};
+  std::atomic<uint64_t> count_{0};
+  std::atomic<uint64_t> total_{0};
+  std::atomic<uint64_t> max_{0};
+};
+
+// Latencies of requests by type and durations of build phases by name.
+// Nothing is measured until enabled
+class Metrics {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  void Enable(bool enabled = true);
+  bool IsEnabled() const;
+
+  void AddRequest(Request::Type type, Clock::duration duration);
+  void AddPhase(const std::string &name, Clock::duration duration);
+  // Only requests and phases which were measured at least once
+  void WriteJSON(Json::Writer &out) const;
+
+private:
+  static constexpr size_t REQUEST_TYPE_COUNT = static_cast<size_t>(Request::Type::STOPS_IN_BOX) + 1;
+
+  std::atomic<bool> enabled_{false};
+  std::array<LatencyHistogram, REQUEST_TYPE_COUNT> requests_;
+  mutable std::mutex phases_mutex_;
+  std::map<std::string, LatencyHistogram> phases_;
+};
+
+// Adds time of its scope to metrics, costs one check if they are disabled
+class MetricsTimer {
+public:
+  MetricsTimer(Metrics &metrics, Request::Type type)
+      : metrics_(metrics.IsEnabled() ? &metrics : nullptr), type_(type) {
+    Start();
+  }
+  MetricsTimer(Metrics &metrics, const char *phase)
+      : metrics_(metrics.IsEnabled() ? &metrics : nullptr), phase_(phase) {
+    Start();
+  }
+  MetricsTimer(const MetricsTimer &) = delete;
+  MetricsTimer &operator=(const MetricsTimer &) = delete;
+
+  ~MetricsTimer() {
+    if (!metrics_) {
+      return;
+    }
+    const auto duration = Metrics::Clock::now() - start_;
+    if (phase_) {
+      metrics_->AddPhase(phase_, duration);
+    } else {
+      metrics_->AddRequest(type_, duration);
+    }
+  }
+
+private:
+  void Start() {
+    if (metrics_) {
+      start_ = Metrics::Clock::now();
+    }
+  }
+
+  Metrics *metrics_;
+  Request::Type type_ = Request::Type::ADD_STOP;
+  const char *phase_ = nullptr;
+  Metrics::Clock::time_point start_;
+};
+}
+
+#endif //YANDEXCPLUSPLUS_5_BLACK_1_WEEK_9_TRANSPORT_BOOK_PART_I_METRICS_H
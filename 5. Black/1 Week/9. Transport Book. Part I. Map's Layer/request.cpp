@@ -1,6 +1,7 @@
 //
 // Created by ilya on 25.11.2019.
 //
+#include <algorithm>
 #include <sstream>
 #include <iomanip>
 #include <unordered_map>
@@ -50,12 +51,19 @@ RequestHolder Request::Create(Request::Type type) {
     return std::make_unique<CreateRouteRequest>();
   case Request::Type::CREATE_MAP:
     return std::make_unique<CreateMapRequest>();
+  case Request::Type::ROUTE_MATRIX:
+    return std::make_unique<RouteMatrixRequest>();
+  case Request::Type::NEAREST_STOPS:
+  case Request::Type::STOPS_IN_RADIUS:
+  case Request::Type::STOPS_IN_BOX:
+    return std::make_unique<FindStopsRequest>(type);
   default:
     return nullptr;
   }
 }
 
-void AddStopRequest::ParseFromJSON(const Json::Node &node) {
+template <typename NodeType>
+void AddStopRequest::Parse(const NodeType &node) {
   const auto& map_elem = node.AsMap();
   stop_name = map_elem.at("name").AsString();
   latitude = map_elem.at("latitude").AsDouble();
@@ -63,45 +71,71 @@ void AddStopRequest::ParseFromJSON(const Json::Node &node) {
   if (map_elem.count("road_distances")) {
     const auto& distance_map = map_elem.at("road_distances").AsMap();
     for (const auto& [key, value] : distance_map) {
-      std::string name = key;
+      std::string name(key);
       int distance = value.AsInt();
       distances.emplace_back(name, distance);
     }
   }
 }
 
+void AddStopRequest::ParseFromJSON(const Json::Node &node) {
+  Parse(node);
+}
+
+void AddStopRequest::ParseFromJSON(const Json::ArenaNode &node) {
+  Parse(node);
+}
+
 void AddStopRequest::Process(Database &db ) const {
-  db.AddStop({stop_name,
-             CoordinatesBuilder().SetLatitude(latitude).SetLongitude(longitude).Build(), distances});
+  db.AddStop({stop_name, CoordinatesBuilder().SetLatitude(latitude).SetLongitude(longitude).Build()},
+            distances);
 }
 
-void AddRouteRequest::ParseFromJSON(const Json::Node &node) {
+template <typename NodeType>
+void AddRouteRequest::Parse(const NodeType &node) {
   const auto& map_elem = node.AsMap();
   route_name = map_elem.at("name").AsString();
   route_type = map_elem.at("is_roundtrip").AsBool() ? Route::RouteTypes::CYCLE : Route::RouteTypes::LINEAR;
   if (map_elem.count("stops")) {
     const auto& stops = map_elem.at("stops").AsArray();
     for (const auto& stop : stops) {
-      stops_name.push_back(stop.AsString());
+      stops_name.emplace_back(stop.AsString());
     }
   }
 }
 
+void AddRouteRequest::ParseFromJSON(const Json::Node &node) {
+  Parse(node);
+}
+
+void AddRouteRequest::ParseFromJSON(const Json::ArenaNode &node) {
+  Parse(node);
+}
+
 void AddRouteRequest::Process(Database &db) const {
   db.AddRoute(route_name,
               RouteBuilder(db).MakeRoute({route_type, route_name, stops_name}));
 }
 
-void TakeRouteRequest::ParseFromJSON(const Json::Node &node) {
+template <typename NodeType>
+void TakeRouteRequest::Parse(const NodeType &node) {
   const auto& map_elem = node.AsMap();
   route_name = map_elem.at("name").AsString();
   request_id = map_elem.at("id").AsInt();
 }
 
+void TakeRouteRequest::ParseFromJSON(const Json::Node &node) {
+  Parse(node);
+}
+
+void TakeRouteRequest::ParseFromJSON(const Json::ArenaNode &node) {
+  Parse(node);
+}
+
 TakeRouteAnswer TakeRouteRequest::Process(Database &db) const {
-  auto route = db.TakeRoute(route_name);
-  if (route) {
-    return {request_id, true, route_name, route->CountOfStops(), route->CountOfUniqueStops(), route->RealLength(), route->Curvature()};
+  auto stat = db.TakeBusStat(route_name);
+  if (stat) {
+    return {request_id, true, route_name, stat->stop_count, stat->unique_stop_count, stat->real_length, stat->curvature};
   }
   else {
     return {request_id, false, route_name, 0, 0, 0, 0};
@@ -123,12 +157,38 @@ Json::Node TakeRouteRequest::JSONAnswer(const TakeRouteAnswer &result) const {
   return Json::Node(answer);
 }
 
-void TakeStopRequest::ParseFromJSON(const Json::Node &node) {
+// Keys go in the same sorted order as in printed Node
+void TakeRouteRequest::WriteAnswer(const TakeRouteAnswer &result, Json::Writer &out) const {
+  out.StartObject();
+  if (result.has_value) {
+    out.Key("curvature").Value(result.curvature);
+    out.Key("request_id").Value(result.id);
+    out.Key("route_length").Value(result.length);
+    out.Key("stop_count").Value(static_cast<int>(result.stops_count));
+    out.Key("unique_stop_count").Value(static_cast<int>(result.unique_stops_count));
+  }
+  else {
+    out.Key("error_message").Value("not found");
+    out.Key("request_id").Value(result.id);
+  }
+  out.EndObject();
+}
+
+template <typename NodeType>
+void TakeStopRequest::Parse(const NodeType &node) {
   const auto& map_elem = node.AsMap();
   stop_name = map_elem.at("name").AsString();
   request_id = map_elem.at("id").AsInt();
 }
 
+void TakeStopRequest::ParseFromJSON(const Json::Node &node) {
+  Parse(node);
+}
+
+void TakeStopRequest::ParseFromJSON(const Json::ArenaNode &node) {
+  Parse(node);
+}
+
 TakeStopAnswer TakeStopRequest::Process(Database &db) const {
   auto stop = db.TakeStop(stop_name);
   if (stop) {
@@ -161,73 +221,274 @@ Json::Node TakeStopRequest::JSONAnswer(const TakeStopAnswer &result) const {
   return Json::Node(answer);
 }
 
-void CreateRouteRequest::ParseFromJSON(const Json::Node &node) {
+void TakeStopRequest::WriteAnswer(const TakeStopAnswer &result, Json::Writer &out) const {
+  out.StartObject();
+  if (result.in_base) {
+    out.Key("buses").StartArray();
+    for (const auto& name : result.names) {
+      out.Value(name);
+    }
+    out.EndArray();
+  }
+  else {
+    out.Key("error_message").Value("not found");
+  }
+  out.Key("request_id").Value(result.id);
+  out.EndObject();
+}
+
+template <typename NodeType>
+void CreateRouteRequest::Parse(const NodeType &node) {
   const auto& map_elem = node.AsMap();
   from = map_elem.at("from").AsString();
   to = map_elem.at("to").AsString();
   request_id = map_elem.at("id").AsInt();
 }
 
+void CreateRouteRequest::ParseFromJSON(const Json::Node &node) {
+  Parse(node);
+}
+
+void CreateRouteRequest::ParseFromJSON(const Json::ArenaNode &node) {
+  Parse(node);
+}
+
 CreateRouteAnswer CreateRouteRequest::Process(Router& db) const {
-  auto nodes = db.CreateRoute(from, to);
-  auto first = dynamic_cast<InfoNode&>(*nodes.front());
-  nodes.pop_front();
-  if (!first.total_time) {
-    return {request_id, false, {}};
-  }
-  return {request_id, true, first.total_time.value(), std::move(nodes)};
+  return {request_id, db.CreateRoute(from, to), db.TakeDatabase()};
 }
 
 Json::Node CreateRouteRequest::JSONAnswer(const CreateRouteAnswer &result) const {
   std::map<std::string, Json::Node> answer;
   answer["request_id"] = Json::Node(result.id);
-  if (!result.has_route) {
+  if (!result.itinerary->total_time) {
     answer["error_message"] = Json::Node(std::string("not found"));
     return answer;
   }
-  answer["total_time"] = Json::Node(result.total_time);
+  answer["total_time"] = Json::Node(*result.itinerary->total_time);
   std::vector<Json::Node> items;
-  for (const auto& node : result.nodes) {
-    if (node->type == NodeType::WAIT) {
-      auto node_wait = dynamic_cast<WaitNode&>(*node);
-      std::map<std::string, Json::Node> wait_ans;
-      wait_ans["type"] = Json::Node(std::string("Wait"));
-      wait_ans["stop_name"] = Json::Node(node_wait.stop_name);
-      wait_ans["time"] = Json::Node(node_wait.time);
-      items.emplace_back(wait_ans);
-    }
-    if (node->type == NodeType::BUS) {
-      auto node_bus = dynamic_cast<BusNode&>(*node);
-      std::map<std::string, Json::Node> bus_ans;
-      bus_ans["type"] = Json::Node(std::string("Bus"));
-      bus_ans["bus"] = Json::Node(node_bus.route_name);
-      bus_ans["span_count"] = Json::Node(node_bus.span_count);
-      bus_ans["time"] = Json::Node(node_bus.time);
-      items.emplace_back(bus_ans);
+  items.reserve(result.itinerary->items.size());
+  for (const auto& item : result.itinerary->items) {
+    std::map<std::string, Json::Node> item_ans;
+    if (item.type == NodeType::WAIT) {
+      item_ans["type"] = Json::Node(std::string("Wait"));
+      item_ans["stop_name"] = Json::Node(ItemName(*result.db, item));
+    } else {
+      item_ans["type"] = Json::Node(std::string("Bus"));
+      item_ans["bus"] = Json::Node(ItemName(*result.db, item));
+      item_ans["span_count"] = Json::Node(item.span_count);
     }
+    item_ans["time"] = Json::Node(item.time);
+    items.emplace_back(item_ans);
   }
   answer["items"] = Json::Node(items);
   return answer;
 }
 
-void CreateMapRequest::ParseFromJSON(const Json::Node &node) {
+void CreateRouteRequest::WriteAnswer(const CreateRouteAnswer &result, Json::Writer &out) const {
+  out.StartObject();
+  if (!result.itinerary->total_time) {
+    out.Key("error_message").Value("not found");
+    out.Key("request_id").Value(result.id);
+    out.EndObject();
+    return;
+  }
+  out.Key("items").StartArray();
+  for (const auto& item : result.itinerary->items) {
+    out.StartObject();
+    if (item.type == NodeType::WAIT) {
+      out.Key("stop_name").Value(ItemName(*result.db, item));
+      out.Key("time").Value(item.time);
+      out.Key("type").Value("Wait");
+    } else {
+      out.Key("bus").Value(ItemName(*result.db, item));
+      out.Key("span_count").Value(item.span_count);
+      out.Key("time").Value(item.time);
+      out.Key("type").Value("Bus");
+    }
+    out.EndObject();
+  }
+  out.EndArray();
+  out.Key("request_id").Value(result.id);
+  out.Key("total_time").Value(*result.itinerary->total_time);
+  out.EndObject();
+}
+
+template <typename NodeType>
+void RouteMatrixRequest::Parse(const NodeType &node) {
+  const auto& map_elem = node.AsMap();
+  for (const auto& stop : map_elem.at("from").AsArray()) {
+    from.emplace_back(stop.AsString());
+  }
+  for (const auto& stop : map_elem.at("to").AsArray()) {
+    to.emplace_back(stop.AsString());
+  }
+  request_id = map_elem.at("id").AsInt();
+}
+
+void RouteMatrixRequest::ParseFromJSON(const Json::Node &node) {
+  Parse(node);
+}
+
+void RouteMatrixRequest::ParseFromJSON(const Json::ArenaNode &node) {
+  Parse(node);
+}
+
+RouteMatrixAnswer RouteMatrixRequest::Process(Router &db) const {
+  return {request_id, from.size(), to.size(), db.CreateRouteMatrix(from, to)};
+}
+
+// Pairs without route get "not found" instead of time
+Json::Node RouteMatrixRequest::JSONAnswer(const RouteMatrixAnswer &result) const {
+  std::map<std::string, Json::Node> answer;
+  answer["request_id"] = Json::Node(result.id);
+  std::vector<Json::Node> rows;
+  for (size_t row_idx = 0; row_idx < result.rows; ++row_idx) {
+    std::vector<Json::Node> row;
+    for (size_t idx = row_idx * result.columns; idx < (row_idx + 1) * result.columns; ++idx) {
+      if (result.times[idx]) {
+        row.emplace_back(*result.times[idx]);
+      } else {
+        row.emplace_back(std::string("not found"));
+      }
+    }
+    rows.emplace_back(std::move(row));
+  }
+  answer["times"] = Json::Node(std::move(rows));
+  return answer;
+}
+
+void RouteMatrixRequest::WriteAnswer(const RouteMatrixAnswer &result, Json::Writer &out) const {
+  out.StartObject();
+  out.Key("request_id").Value(result.id);
+  out.Key("times").StartArray();
+  for (size_t row_idx = 0; row_idx < result.rows; ++row_idx) {
+    out.StartArray();
+    for (size_t idx = row_idx * result.columns; idx < (row_idx + 1) * result.columns; ++idx) {
+      if (result.times[idx]) {
+        out.Value(*result.times[idx]);
+      } else {
+        out.Value("not found");
+      }
+    }
+    out.EndArray();
+  }
+  out.EndArray();
+  out.EndObject();
+}
+
+template <typename NodeType>
+void FindStopsRequest::Parse(const NodeType &node) {
+  const auto& map_elem = node.AsMap();
+  request_id = map_elem.at("id").AsInt();
+  switch (GetType()) {
+  case Request::Type::NEAREST_STOPS:
+    count = map_elem.at("count").AsInt();
+    [[fallthrough]];
+  case Request::Type::STOPS_IN_RADIUS:
+    center = Coordinates(map_elem.at("latitude").AsDouble(), map_elem.at("longitude").AsDouble());
+    if (map_elem.count("radius")) {
+      radius = map_elem.at("radius").AsDouble();
+    }
+    break;
+  default:
+    min_corner = Coordinates(map_elem.at("min_latitude").AsDouble(), map_elem.at("min_longitude").AsDouble());
+    max_corner = Coordinates(map_elem.at("max_latitude").AsDouble(), map_elem.at("max_longitude").AsDouble());
+  }
+}
+
+void FindStopsRequest::ParseFromJSON(const Json::Node &node) {
+  Parse(node);
+}
+
+void FindStopsRequest::ParseFromJSON(const Json::ArenaNode &node) {
+  Parse(node);
+}
+
+FindStopsAnswer FindStopsRequest::Process(Database &db) const {
+  FindStopsAnswer answer{request_id, {}};
+  if (GetType() == Request::Type::STOPS_IN_BOX) {
+    for (const StopId id : db.StopsInBox(min_corner, max_corner)) {
+      answer.stops.push_back({db.TakeStop(id)->GetName(), std::nullopt});
+    }
+    std::sort(answer.stops.begin(), answer.stops.end(), [](const FoundStop &lhs, const FoundStop &rhs) {
+      return lhs.name < rhs.name;
+    });
+    return answer;
+  }
+  const auto found = GetType() == Request::Type::NEAREST_STOPS
+                     ? db.NearestStops(center, count)
+                     : db.StopsWithinRadius(center, radius);
+  for (const auto &stop : found) {
+    answer.stops.push_back({db.TakeStop(stop.id)->GetName(), stop.distance});
+  }
+  return answer;
+}
+
+Json::Node FindStopsRequest::JSONAnswer(const FindStopsAnswer &result) const {
+  std::map<std::string, Json::Node> answer;
+  answer["request_id"] = Json::Node(result.id);
+  std::vector<Json::Node> stops;
+  for (const auto &stop : result.stops) {
+    std::map<std::string, Json::Node> stop_answer;
+    stop_answer["name"] = Json::Node(stop.name);
+    if (stop.distance) {
+      stop_answer["distance"] = Json::Node(*stop.distance);
+    }
+    stops.emplace_back(std::move(stop_answer));
+  }
+  answer["stops"] = Json::Node(std::move(stops));
+  return answer;
+}
+
+void FindStopsRequest::WriteAnswer(const FindStopsAnswer &result, Json::Writer &out) const {
+  out.StartObject();
+  out.Key("request_id").Value(result.id);
+  out.Key("stops").StartArray();
+  for (const auto &stop : result.stops) {
+    out.StartObject();
+    if (stop.distance) {
+      out.Key("distance").Value(*stop.distance);
+    }
+    out.Key("name").Value(stop.name);
+    out.EndObject();
+  }
+  out.EndArray();
+  out.EndObject();
+}
+
+template <typename NodeType>
+void CreateMapRequest::Parse(const NodeType &node) {
   const auto& map_elem = node.AsMap();
   request_id = map_elem.at("id").AsInt();
 }
 
+void CreateMapRequest::ParseFromJSON(const Json::Node &node) {
+  Parse(node);
+}
+
+void CreateMapRequest::ParseFromJSON(const Json::ArenaNode &node) {
+  Parse(node);
+}
+
 CreateMapAnswer CreateMapRequest::Process(TransportDatabase::Map &db) const {
-  db.CreateMap();
-  auto res = db.RenderMap();
-  return {request_id, res};
+  return {request_id, db.BuildMap()};
 }
 
 Json::Node CreateMapRequest::JSONAnswer(const TransportDatabase::CreateMapAnswer &result) const {
   std::map<std::string, Json::Node> answer;
   answer["request_id"] = Json::Node(result.id);
-  answer["map"] = result.svg;
+  answer["map"] = *result.svg;
   std::ofstream dbg("res.svg");
-  dbg << result.svg;
+  dbg << *result.svg;
   return answer;
 }
 
+// Svg is rendered already escaped for JSON
+void CreateMapRequest::WriteAnswer(const CreateMapAnswer &result, Json::Writer &out) const {
+  out.StartObject();
+  out.Key("map").RawString(*result.svg);
+  out.Key("request_id").Value(result.id);
+  out.EndObject();
+}
+
 }
\ No newline at end of file
@@ -8,6 +8,8 @@
 #include <optional>
 
 #include "json.h"
+#include "json_arena.h"
+#include "json_writer.h"
 #include "database.h"
 #include "route.h"
 #include "map.h"
@@ -27,10 +29,17 @@ public:
     TAKE_ROUTE,
     TAKE_STOP,
     CREATE_ROUTE,
-    CREATE_MAP
+    CREATE_MAP,
+    ROUTE_MATRIX,
+    NEAREST_STOPS,
+    STOPS_IN_RADIUS,
+    STOPS_IN_BOX
   };
   explicit Request(Type type) : type_(type) {}
+  // Requests are read from both DOMs, every request parses
+  // them with one template Parse method
   virtual void ParseFromJSON(const Json::Node& node) = 0;
+  virtual void ParseFromJSON(const Json::ArenaNode& node) = 0;
   virtual ~Request() = default;
 
   static RequestHolder Create(Request::Type type);
@@ -47,8 +56,11 @@ class ReadRequest : public Request {
 public:
   using Request::Request;
   void ParseFromJSON(const Json::Node& node) override = 0;
+  void ParseFromJSON(const Json::ArenaNode& node) override = 0;
   virtual Result Process(Processor &db) const = 0;
   virtual Json::Node JSONAnswer(const Result& result) const = 0;
+  // Same answer, written without building nodes
+  virtual void WriteAnswer(const Result& result, Json::Writer& out) const = 0;
 protected:
   int request_id = 0;
 };
@@ -64,8 +76,11 @@ class AddStopRequest : public ModifyRequest<Database> {
 public:
   AddStopRequest() : ModifyRequest(Request::Type::ADD_STOP) {}
   void ParseFromJSON(const Json::Node& node) override;
+  void ParseFromJSON(const Json::ArenaNode& node) override;
   void Process(Database& db) const override;
 private:
+  template <typename NodeType>
+  void Parse(const NodeType& node);
   std::string stop_name;
   double latitude, longitude;
   std::vector<std::pair<std::string, int>> distances;
@@ -75,8 +90,11 @@ class AddRouteRequest : public ModifyRequest<Database> {
 public:
   AddRouteRequest() : ModifyRequest(Request::Type::ADD_ROUTE) {}
   void ParseFromJSON(const Json::Node& node) override;
+  void ParseFromJSON(const Json::ArenaNode& node) override;
   void Process(Database& db) const override;
 private:
+  template <typename NodeType>
+  void Parse(const NodeType& node);
   std::string route_name;
   Route::RouteTypes route_type;
   std::vector<std::string> stops_name;
@@ -96,9 +114,13 @@ class TakeRouteRequest : public ReadRequest<TakeRouteAnswer, Database> {
 public:
   TakeRouteRequest() : ReadRequest(Request::Type::TAKE_ROUTE) {}
   void ParseFromJSON(const Json::Node& node) override;
+  void ParseFromJSON(const Json::ArenaNode& node) override;
   TakeRouteAnswer Process(Database& db) const override;
   Json::Node JSONAnswer(const TakeRouteAnswer& result) const override;
+  void WriteAnswer(const TakeRouteAnswer& result, Json::Writer& out) const override;
 private:
+  template <typename NodeType>
+  void Parse(const NodeType& node);
   std::string route_name;
 };
 
@@ -113,41 +135,108 @@ class TakeStopRequest : public ReadRequest<TakeStopAnswer, Database> {
 public:
   TakeStopRequest() : ReadRequest(Request::Type::TAKE_STOP) {}
   void ParseFromJSON(const Json::Node& node) override;
+  void ParseFromJSON(const Json::ArenaNode& node) override;
   TakeStopAnswer Process(Database& db) const override;
   Json::Node JSONAnswer(const TakeStopAnswer& result) const override;
+  void WriteAnswer(const TakeStopAnswer& result, Json::Writer& out) const override;
 private:
+  template <typename NodeType>
+  void Parse(const NodeType& node);
   std::string stop_name;
 };
 
+// Names of stops and buses are taken from db while the answer is written
 struct CreateRouteAnswer {
   int id;
-  bool has_route;
-  double total_time;
-  std::list<std::unique_ptr<BaseNode>> nodes;
+  std::shared_ptr<const Itinerary> itinerary;
+  std::shared_ptr<const Database> db;
 };
 
 class CreateRouteRequest : public ReadRequest<CreateRouteAnswer, Router> {
 public:
   CreateRouteRequest() : ReadRequest(Request::Type::CREATE_ROUTE) {}
   void ParseFromJSON(const Json::Node& node) override;
+  void ParseFromJSON(const Json::ArenaNode& node) override;
   CreateRouteAnswer Process(Router& db) const override;
   Json::Node JSONAnswer(const CreateRouteAnswer& result) const override;
+  void WriteAnswer(const CreateRouteAnswer& result, Json::Writer& out) const override;
 private:
+  template <typename NodeType>
+  void Parse(const NodeType& node);
   std::string from;
   std::string to;
 };
 
+struct RouteMatrixAnswer {
+  int id;
+  size_t rows;
+  size_t columns;
+  // Row by row, no value if there is no route
+  std::vector<std::optional<double>> times;
+};
+
+class RouteMatrixRequest : public ReadRequest<RouteMatrixAnswer, Router> {
+public:
+  RouteMatrixRequest() : ReadRequest(Request::Type::ROUTE_MATRIX) {}
+  void ParseFromJSON(const Json::Node& node) override;
+  void ParseFromJSON(const Json::ArenaNode& node) override;
+  RouteMatrixAnswer Process(Router& db) const override;
+  Json::Node JSONAnswer(const RouteMatrixAnswer& result) const override;
+  void WriteAnswer(const RouteMatrixAnswer& result, Json::Writer& out) const override;
+private:
+  template <typename NodeType>
+  void Parse(const NodeType& node);
+  std::vector<std::string> from;
+  std::vector<std::string> to;
+};
+
+struct FoundStop {
+  std::string name;
+  std::optional<double> distance;
+};
+
+struct FindStopsAnswer {
+  int id;
+  std::vector<FoundStop> stops;
+};
+
+// NEAREST_STOPS gives count closest stops, STOPS_IN_RADIUS all stops
+// not farther than radius meters, both ordered by distance.
+// STOPS_IN_BOX gives stops between two corners ordered by name
+class FindStopsRequest : public ReadRequest<FindStopsAnswer, Database> {
+public:
+  explicit FindStopsRequest(Request::Type type) : ReadRequest(type) {}
+  void ParseFromJSON(const Json::Node& node) override;
+  void ParseFromJSON(const Json::ArenaNode& node) override;
+  FindStopsAnswer Process(Database& db) const override;
+  Json::Node JSONAnswer(const FindStopsAnswer& result) const override;
+  void WriteAnswer(const FindStopsAnswer& result, Json::Writer& out) const override;
+private:
+  template <typename NodeType>
+  void Parse(const NodeType& node);
+  Coordinates center;
+  size_t count = 0;
+  double radius = 0;
+  Coordinates min_corner;
+  Coordinates max_corner;
+};
+
 struct CreateMapAnswer {
   int id;
-  std::string svg;
+  std::shared_ptr<const std::string> svg;
 };
 
 class CreateMapRequest : public ReadRequest<CreateMapAnswer, Map> {
 public:
   CreateMapRequest() : ReadRequest(Request::Type::CREATE_MAP) {}
   void ParseFromJSON(const Json::Node& node) override;
+  void ParseFromJSON(const Json::ArenaNode& node) override;
   CreateMapAnswer Process(Map& db) const override;
   Json::Node JSONAnswer(const CreateMapAnswer& result) const override;
+  void WriteAnswer(const CreateMapAnswer& result, Json::Writer& out) const override;
+private:
+  template <typename NodeType>
+  void Parse(const NodeType& node);
 };
 }
 #endif //YANDEXYELLOWFINAL_4_BROWN_FINAL_PROJECT_PART_A_REQUEST_H
@@ -3,7 +3,9 @@
 //
 
 #include "route.h"
+#include "executor.h"
 
+#include <algorithm>
 #include <utility>
 
 namespace TransportDatabase {
@@ -16,6 +18,44 @@ Router::Router(std::shared_ptr<Database> db, const RoutingParam& rp) : Connector
   Rebase();
 }
 
+Router::Router(std::shared_ptr<Database> db, Serialization::Reader &in) : Connector(std::move(db)) {
+  Serialization::Deserialize(in, routing_param);
+  route_cache.SetCapacity(routing_param.route_cache_size);
+  uint64_t vertex_count = 0;
+  uint64_t edges_count = 0;
+  Serialization::Deserialize(in, vertex_count);
+  Serialization::Deserialize(in, edges_count);
+  graph = std::make_unique<Graph::DirectedWeightedGraph<WeightType>>(vertex_count);
+  EdgeBuffer buffer;
+  buffer.graph_edges.reserve(edges_count);
+  buffer.edges.reserve(edges_count);
+  for (uint64_t i = 0; i < edges_count; ++i) {
+    Edge edge;
+    Graph::Edge<WeightType> graph_edge;
+    Serialization::Deserialize(in, edge.type);
+    Serialization::Deserialize(in, graph_edge.weight);
+    Serialization::Deserialize(in, edge.span_count);
+    Serialization::Deserialize(in, edge.id);
+    Serialization::Deserialize(in, graph_edge.from);
+    Serialization::Deserialize(in, graph_edge.to);
+    buffer.Add(graph_edge, edge);
+  }
+  AddEdges(std::move(buffer));
+  Serialization::Deserialize(in, stop_vertices);
+  built_routes = db_->TakeRoutes().size();
+  built_version = db_->GetVersion();
+  switch (routing_param.router_type) {
+  case RouterType::TILED_ALL_PAIRS:
+    router = std::make_unique<Graph::TiledRouter<WeightType>>(*graph, in);
+    break;
+  case RouterType::CONTRACTION_HIERARCHY:
+    router = std::make_unique<Graph::ContractionHierarchyRouter<WeightType>>(*graph, in);
+    break;
+  default:
+    RebaseRouter();
+  }
+}
+
 void Router::ChangeDatabase(std::shared_ptr<Database> db) {
   Connector::ChangeDatabase(db);
   Rebase();
@@ -24,137 +64,329 @@ void Router::ChangeDatabase(std::shared_ptr<Database> db) {
 void Router::ChangeRoutingParams(const RoutingParam &rp) {
   routing_param.velocity = rp.velocity;
   routing_param.waiting_time = rp.waiting_time;
+  routing_param.router_type = rp.router_type;
+  routing_param.graph_type = rp.graph_type;
+  routing_param.route_cache_size = rp.route_cache_size;
+  route_cache.SetCapacity(rp.route_cache_size);
+  params_changed = true;
 }
 
-std::list<std::unique_ptr<BaseNode>> Router::CreateRoute(const std::string& first_stop,
-                                                         const std::string& second_stop) const {
+const std::string &ItemName(const Database &db, const Itinerary::Item &item) {
+  if (item.type == NodeType::WAIT) {
+    return db.TakeStops().at(item.id)->GetName();
+  }
+  return db.TakeRoutes().at(item.id)->GetName();
+}
+
+std::shared_ptr<const Itinerary> Router::CreateRoute(const std::string& first_stop,
+                                                     const std::string& second_stop) const {
   if (!graph) throw std::runtime_error("graph in database router not set");
   if (!router) throw std::runtime_error("router in database router not set");
-  auto route = router->BuildRoute(name_to_vertex_id.at(first_stop).first,name_to_vertex_id.at(second_stop).first);
-  std::list<std::unique_ptr<BaseNode>> nodes;
-  if (!route) {
-    nodes.push_back(std::make_unique<InfoNode>());
-    return nodes;
-  }
-  nodes.push_back(std::make_unique<InfoNode>(route->weight));
-  for (size_t i = 0; i < route->edge_count; ++i) {
-    Graph::EdgeId edge_id = router->GetRouteEdge(route->id, i);
-    Edge edge = edges.at(edge_id);
-    if (edge.is_wait_edge) {
-      nodes.push_back(std::make_unique<WaitNode>(vertex_id_to_name.at(edge.from).first,
-                                                 edge.weight));
+  auto first_id = db_->FindStop(first_stop);
+  auto second_id = db_->FindStop(second_stop);
+  if (!first_id || !second_id) throw std::out_of_range("unknown stop in route request");
+  const VertexPair vertices = {StopVertices(*first_id).first, StopVertices(*second_id).first};
+  if (auto itinerary = route_cache.Find(vertices)) {
+    return *itinerary;
+  }
+  auto itinerary = BuildItinerary(vertices.first, vertices.second);
+  route_cache.Put(vertices, itinerary);
+  return itinerary;
+}
+
+// Edges of the route are written into the buffer of the thread,
+// nothing is left in the router
+std::shared_ptr<const Itinerary> Router::BuildItinerary(Graph::VertexId from, Graph::VertexId to) const {
+  static thread_local std::vector<Graph::EdgeId> route_edges;
+  auto itinerary = std::make_shared<Itinerary>();
+  itinerary->total_time = router->BuildRouteEdges(from, to, route_edges);
+  if (!itinerary->total_time) {
+    return itinerary;
+  }
+  itinerary->items.reserve(route_edges.size());
+  for (const Graph::EdgeId edge_id : route_edges) {
+    const Edge& edge = edges[edge_id];
+    const WeightType weight = graph->GetEdge(edge_id).weight;
+    switch (edge.type) {
+    case EdgeType::WAIT:
+      itinerary->items.push_back({NodeType::WAIT, edge.id, 0, weight});
+      break;
+    case EdgeType::BUS:
+      itinerary->items.push_back({NodeType::BUS, edge.id, edge.span_count, weight});
+      break;
+    case EdgeType::BOARD:
+      itinerary->items.push_back({NodeType::BUS, edge.id, 0, 0});
+      break;
+    case EdgeType::RIDE:
+      itinerary->items.back().span_count += edge.span_count;
+      itinerary->items.back().time += weight;
+      break;
+    case EdgeType::ALIGHT:
+      break;
     }
-    else {
-      nodes.push_back(std::make_unique<BusNode>(edge.bus_name, edge.span_count, edge.weight));
+  }
+  return itinerary;
+}
+
+std::vector<std::optional<double>> Router::CreateRouteMatrix(const std::vector<std::string> &from,
+                                                             const std::vector<std::string> &to) const {
+  if (!graph) throw std::runtime_error("graph in database router not set");
+  if (!router) throw std::runtime_error("router in database router not set");
+  // Positions of known stops in the request and their vertices
+  auto known_stops = [this](const std::vector<std::string>& names) {
+    std::pair<std::vector<size_t>, std::vector<Graph::VertexId>> result;
+    for (size_t idx = 0; idx < names.size(); ++idx) {
+      auto id = db_->FindStop(names[idx]);
+      if (id && *id < stop_vertices.size()) {
+        result.first.push_back(idx);
+        result.second.push_back(StopVertices(*id).first);
+      }
+    }
+    return result;
+  };
+  const auto [rows, sources] = known_stops(from);
+  const auto [columns, targets] = known_stops(to);
+  auto weights = router->BuildWeightMatrix(sources, targets);
+
+  std::vector<std::optional<double>> times(from.size() * to.size());
+  for (size_t row = 0; row < rows.size(); ++row) {
+    for (size_t column = 0; column < columns.size(); ++column) {
+      times[rows[row] * to.size() + columns[column]] = weights[row * columns.size() + column];
     }
   }
-  return nodes;
+  return times;
+}
+
+CacheStats Router::GetRouteCacheStats() const {
+  return route_cache.GetStats();
+}
+
+BuildStats Router::GetBuildStats() const {
+  return build_stats;
 }
 
+// All-pairs table is saved only in flat layout of TILED_ALL_PAIRS
+void Router::Serialize(std::ostream &out) const {
+  if (!graph) throw std::runtime_error("graph in database router not set");
+  if (!router) throw std::runtime_error("router in database router not set");
+  if (routing_param.router_type == RouterType::ALL_PAIRS
+      || routing_param.router_type == RouterType::COMPACT_ALL_PAIRS) {
+    throw std::runtime_error("all pairs router can not be saved, use tiled one");
+  }
+  Serialization::Serialize(routing_param, out);
+  Serialization::Serialize(static_cast<uint64_t>(graph->GetVertexCount()), out);
+  Serialization::Serialize(static_cast<uint64_t>(graph->GetEdgeCount()), out);
+  for (Graph::EdgeId edge_id = 0; edge_id < graph->GetEdgeCount(); ++edge_id) {
+    const Edge& edge = edges[edge_id];
+    const auto& graph_edge = graph->GetEdge(edge_id);
+    Serialization::Serialize(edge.type, out);
+    Serialization::Serialize(graph_edge.weight, out);
+    Serialization::Serialize(edge.span_count, out);
+    Serialization::Serialize(edge.id, out);
+    Serialization::Serialize(graph_edge.from, out);
+    Serialization::Serialize(graph_edge.to, out);
+  }
+  Serialization::Serialize(stop_vertices, out);
+  if (routing_param.router_type == RouterType::TILED_ALL_PAIRS) {
+    dynamic_cast<const Graph::TiledRouter<WeightType>&>(*router).Save(out);
+  }
+  if (routing_param.router_type == RouterType::CONTRACTION_HIERARCHY) {
+    dynamic_cast<const Graph::ContractionHierarchyRouter<WeightType>&>(*router).Save(out);
+  }
+}
+
+// Dijkstra searches the grown graph right away, routers with
+// precomputed data are built again over it
 void Router::UpdateGraph() {
-  Rebase();
+  if (!graph || params_changed || db_->GetRewriteVersion() > built_version) {
+    Rebase();
+    return;
+  }
+  if (built_version == db_->GetVersion()) {
+    return;
+  }
+  route_cache.Clear();
+  AppendToGraph();
+  if (routing_param.router_type != RouterType::DIJKSTRA) {
+    RebaseRouter();
+  }
 }
 
 void Router::Rebase() {
-  name_to_vertex_id.clear();
-  vertex_id_to_name.clear();
   edges.clear();
-  curr_id = 0;
-  AddStops();
-  RebaseGraph();
+  stop_vertices.clear();
+  built_routes = 0;
+  params_changed = false;
+  route_cache.Clear();
+  graph = std::make_unique<Graph::DirectedWeightedGraph<WeightType>>();
+  const auto start = std::chrono::steady_clock::now();
+  AppendToGraph();
+  const auto graph_built = std::chrono::steady_clock::now();
   RebaseRouter();
+  build_stats = {graph_built - start, std::chrono::steady_clock::now() - graph_built};
 }
 
-void Router::RebaseGraph() {
-  auto new_graph = Graph::DirectedWeightedGraph<WeightType>(name_to_vertex_id.size() * 2);
-  auto& stops = db_->TakeStops();
-  for (const auto& [stop_name, stop_ptr] : stops) {
-    auto from = name_to_vertex_id.at(stop_name).first;
-    auto to = name_to_vertex_id.at(stop_name).second;
-    auto edge = new_graph.AddEdge({from,
-                                   to,
-                                   routing_param.waiting_time});
-    edges[edge] = {true, routing_param.waiting_time, 0, "no", from, to};
-  }
-  auto& routes = db_->TakeRoutes();
-  for (const auto& [route_name, route_ptr] : routes) {
-    if (route_ptr->route_type == Route::RouteTypes::CYCLE) {
-      MakeWieghtFromCycleRoute(new_graph, route_ptr);
-    }
-    if (route_ptr->route_type == Route::RouteTypes::LINEAR) {
-      MakeWieghtFromLinearRoute(new_graph, route_ptr);
+void Router::AppendToGraph() {
+  const auto& stops = db_->TakeStops();
+  EdgeBuffer new_edges;
+  for (size_t id = stop_vertices.size(); id < stops.size(); ++id) {
+    AppendStop(*stops[id], new_edges);
+  }
+
+  const auto& routes = db_->TakeRoutes();
+  const size_t first_route = built_routes;
+  std::vector<Graph::VertexId> first_rides;
+  for (size_t idx = first_route; idx < routes.size(); ++idx) {
+    first_rides.push_back(graph->AddVertices(RideVertexCount(*routes[idx])));
+  }
+  std::vector<EdgeBuffer> buffers(routes.size() - first_route);
+  ParallelFor(buffers.size(), [this, &routes, &first_rides, &buffers, first_route](size_t idx) {
+    AppendRoute(*routes[first_route + idx], first_rides[idx], buffers[idx]);
+  });
+  size_t edge_count = new_edges.edges.size();
+  for (const auto& buffer : buffers) {
+    edge_count += buffer.edges.size();
+  }
+  new_edges.graph_edges.reserve(edge_count);
+  new_edges.edges.reserve(edge_count);
+  for (auto& buffer : buffers) {
+    new_edges.graph_edges.insert(new_edges.graph_edges.end(), buffer.graph_edges.begin(), buffer.graph_edges.end());
+    new_edges.edges.insert(new_edges.edges.end(), buffer.edges.begin(), buffer.edges.end());
+    buffer = {};
+  }
+  AddEdges(std::move(new_edges));
+  built_routes = routes.size();
+  built_version = db_->GetVersion();
+}
+
+void Router::AppendStop(const Stop& stop, EdgeBuffer& buffer) {
+  const Graph::VertexId from = graph->AddVertices(2);
+  const Graph::VertexId to = from + 1;
+  stop_vertices.push_back(from);
+  buffer.Add({from, to, routing_param.waiting_time}, {EdgeType::WAIT, 0, stop.GetId()});
+}
+
+size_t Router::RideVertexCount(const Route& route) const {
+  if (routing_param.graph_type != GraphType::RIDE_VERTICES) {
+    return 0;
+  }
+  const size_t chain_count = route.route_type == Route::RouteTypes::LINEAR ? 2 : 1;
+  return chain_count * route.GetStops().size();
+}
+
+void Router::AppendRoute(const Route& route, Graph::VertexId first_ride, EdgeBuffer& buffer) const {
+  if (routing_param.graph_type == GraphType::RIDE_VERTICES) {
+    auto stops = route.GetStops();
+    MakeRideChain(route, stops, first_ride, buffer);
+    if (route.route_type == Route::RouteTypes::LINEAR) {
+      std::reverse(stops.begin(), stops.end());
+      MakeRideChain(route, stops, first_ride + stops.size(), buffer);
     }
+    return;
+  }
+  if (route.route_type == Route::RouteTypes::CYCLE) {
+    MakeWieghtFromCycleRoute(route, buffer);
+  }
+  if (route.route_type == Route::RouteTypes::LINEAR) {
+    MakeWieghtFromLinearRoute(route, buffer);
   }
-  graph = std::make_unique<Graph::DirectedWeightedGraph<WeightType>>(std::move(new_graph));
 }
 
 void Router::RebaseRouter() {
-  router = std::make_unique<Graph::Router<WeightType>>(Graph::Router(*graph));
+  switch (routing_param.router_type) {
+  case RouterType::ALL_PAIRS:
+    router = std::make_unique<Graph::Router<WeightType>>(*graph);
+    break;
+  case RouterType::TILED_ALL_PAIRS:
+    router = std::make_unique<Graph::TiledRouter<WeightType>>(*graph);
+    break;
+  case RouterType::COMPACT_ALL_PAIRS:
+    router = std::make_unique<Graph::Router<WeightType, Graph::CompactRoutesTable<WeightType>>>(*graph);
+    break;
+  case RouterType::DIJKSTRA:
+    router = std::make_unique<Graph::DijkstraRouter<WeightType>>(*graph);
+    break;
+  case RouterType::CONTRACTION_HIERARCHY:
+    router = std::make_unique<Graph::ContractionHierarchyRouter<WeightType>>(*graph);
+    break;
+  default:
+    throw std::runtime_error("unknown router type");
+  }
 }
 
-void Router::MakeWieghtFromCycleRoute(Graph::DirectedWeightedGraph<WeightType> &graph,
-                                      const std::shared_ptr<Route> &ptr) {
-  auto& stops = db_->TakeStops();
-  auto stop_names = ptr->GetStopsName();
-  for (size_t i = 0; i < stop_names.size() - 1; ++i) {
+void Router::MakeWieghtFromCycleRoute(const Route &route, EdgeBuffer &buffer) const {
+  const auto& stops = route.GetStops();
+  for (size_t i = 0; i < stops.size() - 1; ++i) {
     double accumulate_time = 0;
     int span_count = 0;
-    for (size_t j = i + 1; j < stop_names.size(); ++j) {
-      accumulate_time += stops.at(stop_names[j - 1])->distance_to_stop.at(stop_names[j]) * 1.0 / Velocity();
+    for (size_t j = i + 1; j < stops.size(); ++j) {
+      accumulate_time += db_->Distance(stops[j - 1], stops[j]) * 1.0 / Velocity();
       span_count++;
-      auto from = name_to_vertex_id.at(stop_names[i]).second;
-      auto to = name_to_vertex_id.at(stop_names[j]).first;
-      auto edge = graph.AddEdge({from,
-                                 to,
-                                 accumulate_time});
-      edges[edge] = {false, accumulate_time, span_count, ptr->GetName(), from, to};
+      auto from = StopVertices(stops[i]).second;
+      auto to = StopVertices(stops[j]).first;
+      buffer.Add({from, to, accumulate_time}, {EdgeType::BUS, span_count, route.GetId()});
     }
   }
 }
 
 // TODO Возможно нужно переделать
-void Router::MakeWieghtFromLinearRoute(Graph::DirectedWeightedGraph<WeightType> &graph,
-                                       const std::shared_ptr<Route> &ptr) {
-  auto& stops = db_->TakeStops();
-  auto stop_names = ptr->GetStopsName();
-  for (int64_t i = 0; i < stop_names.size(); ++i) {
+void Router::MakeWieghtFromLinearRoute(const Route &route, EdgeBuffer &buffer) const {
+  const auto& stops = route.GetStops();
+  for (int64_t i = 0; i < stops.size(); ++i) {
     double accumulate_time_str = 0;
     int span_count_str = 0;
     double accumulate_time_rev = 0;
     int span_count_rev = 0;
     for (int64_t j = i - 1; j >= 0; --j) {
-      accumulate_time_rev += stops.at(stop_names[j + 1])->distance_to_stop.at(stop_names[j]) * 1.0 / Velocity();
+      accumulate_time_rev += db_->Distance(stops[j + 1], stops[j]) * 1.0 / Velocity();
       span_count_rev++;
-      auto from = name_to_vertex_id.at(stop_names[i]).second;
-      auto to = name_to_vertex_id.at(stop_names[j]).first;
-      auto edge = graph.AddEdge({from,
-                                 to,
-                                 accumulate_time_rev});
-      edges[edge] = {false, accumulate_time_rev, span_count_rev, ptr->GetName(), from, to};
+      auto from = StopVertices(stops[i]).second;
+      auto to = StopVertices(stops[j]).first;
+      buffer.Add({from, to, accumulate_time_rev}, {EdgeType::BUS, span_count_rev, route.GetId()});
     }
-    for (int64_t j = i + 1; j < stop_names.size(); ++j) {
-      accumulate_time_str += stops.at(stop_names[j - 1])->distance_to_stop.at(stop_names[j]) * 1.0 / Velocity();
+    for (int64_t j = i + 1; j < stops.size(); ++j) {
+      accumulate_time_str += db_->Distance(stops[j - 1], stops[j]) * 1.0 / Velocity();
       span_count_str++;
-      auto from = name_to_vertex_id.at(stop_names[i]).second;
-      auto to = name_to_vertex_id.at(stop_names[j]).first;
-      auto edge = graph.AddEdge({from,
-                                 to,
-                                 accumulate_time_str});
-      edges[edge] = {false, accumulate_time_str, span_count_str, ptr->GetName(), from, to};
+      auto from = StopVertices(stops[i]).second;
+      auto to = StopVertices(stops[j]).first;
+      buffer.Add({from, to, accumulate_time_str}, {EdgeType::BUS, span_count_str, route.GetId()});
     }
   }
 }
 
-void Router::AddStops() {
-  auto& stops = db_->TakeStops();
-  for (const auto& [stop_name, stop_ptr] : stops) {
-    name_to_vertex_id[stop_name] = {curr_id, curr_id + 1};
-    vertex_id_to_name[curr_id] = {stop_name, "start"};
-    vertex_id_to_name[curr_id + 1] = {stop_name, "end"};
-    curr_id += 2;
+// Chain of ride vertices along the stops of the bus: passenger boards
+// from the stop after waiting, rides any number of spans and alights
+// to the stop, so changing the bus costs one more wait
+void Router::MakeRideChain(const Route &route, const std::vector<StopId> &stops, Graph::VertexId first_ride,
+                           EdgeBuffer &buffer) const {
+  for (size_t i = 0; i < stops.size(); ++i) {
+    Graph::VertexId ride = first_ride + i;
+    if (i + 1 < stops.size()) {
+      auto from = StopVertices(stops[i]).second;
+      buffer.Add({from, ride, 0}, {EdgeType::BOARD, 0, route.GetId()});
+      double time = db_->Distance(stops[i], stops[i + 1]) * 1.0 / Velocity();
+      buffer.Add({ride, ride + 1, time}, {EdgeType::RIDE, 1, route.GetId()});
+    }
+    if (i > 0) {
+      auto to = StopVertices(stops[i]).first;
+      buffer.Add({ride, to, 0}, {EdgeType::ALIGHT, 0, route.GetId()});
+    }
   }
 }
 
+void Router::AddEdges(EdgeBuffer &&buffer) {
+  graph->AddEdges(std::move(buffer.graph_edges));
+  if (edges.empty()) {
+    edges = std::move(buffer.edges);
+  } else {
+    edges.insert(edges.end(), buffer.edges.begin(), buffer.edges.end());
+  }
+}
+
+std::pair<Graph::VertexId, Graph::VertexId> Router::StopVertices(StopId id) const {
+  return {stop_vertices.at(id), stop_vertices.at(id) + 1};
+}
+
 double Router::Velocity() const {
   return routing_param.velocity * 1000.0 / 60.0;
 }
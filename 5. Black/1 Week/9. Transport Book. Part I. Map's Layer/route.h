@@ -5,90 +5,154 @@
 #ifndef YANDEXCPLUSPLUS_5_BLACK_1_WEEK_7_TRANSPORT_BOOK_PART_G_MAP_ROUTE_H
 #define YANDEXCPLUSPLUS_5_BLACK_1_WEEK_7_TRANSPORT_BOOK_PART_G_MAP_ROUTE_H
 
+#include <chrono>
 #include <memory>
-#include <list>
 #include <optional>
+#include <vector>
 
 #include "graph.h"
 #include "dijkstra.h"
+#include "dijkstra_router.h"
+#include "contraction_hierarchy.h"
+#include "tiled_router.h"
 #include "connector.h"
+#include "lru_cache.h"
+#include "serialization.h"
 
 namespace TransportDatabase {
-enum class NodeType {INFO, WAIT, BUS};
-struct BaseNode {
-  BaseNode() = default;
-  BaseNode(NodeType t) : type(t) {}
-  virtual ~BaseNode() = default;
-  NodeType type;
-};
+enum class NodeType {WAIT, BUS};
 
-struct InfoNode : public BaseNode {
-  using BaseNode::BaseNode;
-  InfoNode() = default;
-  InfoNode(double val) : BaseNode(NodeType::INFO), total_time(val) {}
+// Found route in one array, items keep ids of stops and buses,
+// their names are looked up only when the answer is written
+struct Itinerary {
+  struct Item {
+    NodeType type;
+    // Id of the stop for WAIT, of the bus for BUS
+    uint32_t id;
+    int span_count;
+    double time;
+  };
+  // No value if there is no route
   std::optional<double> total_time;
+  std::vector<Item> items;
 };
 
-struct WaitNode : public BaseNode {
-  using BaseNode::BaseNode;
-  WaitNode() = default;
-  WaitNode(const std::string& stop_name_, double time_)
-      : BaseNode(NodeType::WAIT), stop_name(stop_name_), time(time_) {}
-  std::string stop_name;
-  double time;
-};
+// Name of the stop or bus of the item in database the route was built from
+const std::string &ItemName(const Database &db, const Itinerary::Item &item);
 
-struct BusNode : public BaseNode {
-  using BaseNode::BaseNode;
-  BusNode() = default;
-  BusNode(const std::string& route_name_, int span_count_, double time_)
-      : BaseNode(NodeType::BUS), route_name(route_name_), span_count(span_count_), time(time_) {}
-  std::string route_name;
-  int span_count;
-  double time;
-};
+// ALL_PAIRS precomputes every route while building,
+// TILED_ALL_PAIRS builds the same table in several threads,
+// COMPACT_ALL_PAIRS keeps it in float weights and 32-bit edges, 4 times smaller,
+// DIJKSTRA searches each route on demand,
+// CONTRACTION_HIERARCHY preprocesses graph for fast bidirectional search
+enum class RouterType {ALL_PAIRS, TILED_ALL_PAIRS, DIJKSTRA, CONTRACTION_HIERARCHY, COMPACT_ALL_PAIRS};
+
+// STOP_TO_STOP connects every stop of a bus with every later one,
+// RIDE_VERTICES gives each bus its own chain of vertices, so the graph
+// grows linearly with the total length of routes
+enum class GraphType {STOP_TO_STOP, RIDE_VERTICES};
 
 struct RoutingParam {
   double velocity;
   double waiting_time;
+  RouterType router_type = RouterType::ALL_PAIRS;
+  GraphType graph_type = GraphType::STOP_TO_STOP;
+  // Found routes kept for repeated requests, 0 turns cache off
+  uint64_t route_cache_size = 4096;
+};
+
+// Time of the last full rebuild of graph and router
+struct BuildStats {
+  std::chrono::steady_clock::duration graph{};
+  std::chrono::steady_clock::duration router{};
 };
 
 class Router : public Connector {
   using WeightType = double;
+  // BUS is a whole trip of STOP_TO_STOP graph,
+  // BOARD, RIDE and ALIGHT are parts of a trip in RIDE_VERTICES graph
+  enum class EdgeType {WAIT, BUS, BOARD, RIDE, ALIGHT};
+  // Ends and weight of the edge are kept only in graph
   struct Edge {
-    bool is_wait_edge;
-    WeightType weight;
+    EdgeType type;
     int span_count;
-    std::string bus_name;
-    Graph::VertexId from;
-    Graph::VertexId to;
+    // Id of the bus, for WAIT it is id of the stop
+    uint32_t id;
+  };
+  // Edges made apart from graph, they get ids when the buffer is added
+  struct EdgeBuffer {
+    std::vector<Graph::Edge<WeightType>> graph_edges;
+    std::vector<Edge> edges;
+    void Add(const Graph::Edge<WeightType>& graph_edge, const Edge& edge) {
+      graph_edges.push_back(graph_edge);
+      edges.push_back(edge);
+    }
+  };
+  using VertexPair = std::pair<Graph::VertexId, Graph::VertexId>;
+  struct VertexPairHash {
+    size_t operator()(const VertexPair& vertices) const {
+      return vertices.first * 1'000'003 + vertices.second;
+    }
   };
 public:
   Router();
   Router(std::shared_ptr<Database> db, const RoutingParam& rp);
+  // Restores graph and router saved by Serialize, nothing is rebuilt.
+  // Loaded router may point into the reader buffer, so it has to outlive router
+  Router(std::shared_ptr<Database> db, Serialization::Reader& in);
   void ChangeDatabase(std::shared_ptr<Database> db) override;
   void ChangeRoutingParams(const RoutingParam& rp);
-  std::list<std::unique_ptr<BaseNode>> CreateRoute(const std::string &first_stop, const std::string &second_stop) const;
+  // Shared with the route cache, throws std::out_of_range for unknown stops
+  std::shared_ptr<const Itinerary> CreateRoute(const std::string &first_stop, const std::string &second_stop) const;
+  // Times of routes from every stop of from to every stop of to, row by row,
+  // without building the routes. Unknown stops have no routes
+  std::vector<std::optional<double>> CreateRouteMatrix(const std::vector<std::string> &from,
+                                                       const std::vector<std::string> &to) const;
+  // Appends stops and buses added to database since the last update,
+  // rebuilds everything if stops or buses in graph were changed.
+  // Must not run together with CreateRoute
   void UpdateGraph();
+  CacheStats GetRouteCacheStats() const;
+  BuildStats GetBuildStats() const;
+  void Serialize(std::ostream& out) const;
   RoutingParam routing_param;
 private:
 
-  void AddStops();
   void Rebase();
-  void RebaseGraph();
+  // Adds stops and buses which are not in graph yet. Edges of buses are
+  // made in parallel, one buffer per bus, and added in order of buses,
+  // so ids of edges do not depend on threads
+  void AppendToGraph();
   void RebaseRouter();
+  std::shared_ptr<const Itinerary> BuildItinerary(Graph::VertexId from, Graph::VertexId to) const;
 
-  void MakeWieghtFromCycleRoute(Graph::DirectedWeightedGraph<WeightType>& graph, const std::shared_ptr<Route>& ptr);
-  void MakeWieghtFromLinearRoute(Graph::DirectedWeightedGraph<WeightType>& graph, const std::shared_ptr<Route>& ptr);
+  // Edges are added to graph only here, so their ids index edges
+  void AddEdges(EdgeBuffer&& buffer);
+  void AppendStop(const Stop& stop, EdgeBuffer& buffer);
+  // Vertices of the bus besides the stop ones
+  size_t RideVertexCount(const Route& route) const;
+  void AppendRoute(const Route& route, Graph::VertexId first_ride, EdgeBuffer& buffer) const;
+  void MakeWieghtFromCycleRoute(const Route& route, EdgeBuffer& buffer) const;
+  void MakeWieghtFromLinearRoute(const Route& route, EdgeBuffer& buffer) const;
+  void MakeRideChain(const Route& route, const std::vector<StopId>& stops, Graph::VertexId first_ride,
+                     EdgeBuffer& buffer) const;
 
   double Velocity() const;
+  // Waiting and boarding vertices of the stop
+  std::pair<Graph::VertexId, Graph::VertexId> StopVertices(StopId id) const;
   std::unique_ptr<Graph::DirectedWeightedGraph<WeightType>> graph = nullptr;
-  std::unique_ptr<Graph::Router<WeightType>> router = nullptr;
+  std::unique_ptr<Graph::BaseRouter<WeightType>> router = nullptr;
 
-  Graph::VertexId curr_id = 0;
-  std::unordered_map<std::string, std::pair<Graph::VertexId, Graph::VertexId>> name_to_vertex_id;
-  std::unordered_map<Graph::VertexId, std::pair<std::string, std::string>> vertex_id_to_name;
-  std::unordered_map<Graph::EdgeId, Edge> edges;
+  // Waiting vertex of every stop in graph, boarding one goes right after it
+  std::vector<Graph::VertexId> stop_vertices;
+  size_t built_routes = 0;
+  uint64_t built_version = 0;
+  bool params_changed = false;
+  BuildStats build_stats;
+  // Indexed by id of the edge in graph
+  std::vector<Edge> edges;
+  // Cleared with every change of graph
+  mutable LruCache<VertexPair, std::shared_ptr<const Itinerary>, VertexPairHash> route_cache;
 };
 }
 
@@ -0,0 +1,83 @@
+//
+// Created by ilya on 02.06.2020.
+//
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "serialization.h"
+
+namespace Serialization {
+void Serialize(const std::string &str, std::ostream &out) {
+  Serialize(static_cast<uint64_t>(str.size()), out);
+  out.write(str.data(), str.size());
+}
+
+void Align(std::ostream &out, size_t alignment) {
+  auto pos = static_cast<size_t>(out.tellp());
+  while (pos % alignment) {
+    out.put(0);
+    ++pos;
+  }
+}
+
+void Deserialize(Reader &in, std::string &str) {
+  uint64_t size = 0;
+  Deserialize(in, size);
+  str.assign(in.Take(size), size);
+}
+
+const char *Reader::Take(size_t size) {
+  if (size > size_ - pos_) {
+    throw std::runtime_error("unexpected end of serialized base");
+  }
+  const char *result = data_ + pos_;
+  pos_ += size;
+  return result;
+}
+
+void Reader::Align(size_t alignment) {
+  Take((alignment - pos_ % alignment) % alignment);
+}
+
+MappedFile::MappedFile(const std::string &path) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw std::runtime_error("can not open base file " + path);
+  }
+  struct stat file_stat{};
+  if (fstat(fd, &file_stat) < 0) {
+    close(fd);
+    throw std::runtime_error("can not stat base file " + path);
+  }
+  size_ = static_cast<size_t>(file_stat.st_size);
+  if (size_ > 0) {
+    data_ = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  close(fd);
+  if (data_ == MAP_FAILED) {
+    data_ = nullptr;
+    throw std::runtime_error("can not map base file " + path);
+  }
+}
+
+MappedFile::~MappedFile() {
+  if (data_) {
+    munmap(data_, size_);
+  }
+}
+
+const char *MappedFile::Data() const {
+  return static_cast<const char *>(data_);
+}
+
+size_t MappedFile::Size() const {
+  return size_;
+}
+
+Reader MappedFile::MakeReader() const {
+  return Reader(Data(), Size());
+}
+}
@@ -0,0 +1,113 @@
+//
+// Created by ilya on 02.06.2020.
+//
+
+#ifndef YANDEXCPLUSPLUS_5_BLACK_1_WEEK_9_TRANSPORT_BOOK_PART_I_SERIALIZATION_H
+#define YANDEXCPLUSPLUS_5_BLACK_1_WEEK_9_TRANSPORT_BOOK_PART_I_SERIALIZATION_H
+
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// Binary base of transport database. Values are written in native byte
+// order, big arrays are aligned, so they can be used right from mapped memory.
+namespace Serialization {
+
+class Reader;
+
+template <typename T>
+void Serialize(const T &pod, std::ostream &out);
+void Serialize(const std::string &str, std::ostream &out);
+template <typename T>
+void Serialize(const std::vector<T> &data, std::ostream &out);
+// Pads stream with zeros up to the alignment
+void Align(std::ostream &out, size_t alignment);
+
+template <typename T>
+void Deserialize(Reader &in, T &pod);
+void Deserialize(Reader &in, std::string &str);
+template <typename T>
+void Deserialize(Reader &in, std::vector<T> &data);
+
+// Sequential reading from memory buffer
+class Reader {
+public:
+  Reader(const char *data, size_t size) : data_(data), size_(size) {}
+  const char *Take(size_t size);
+  void Align(size_t alignment);
+  // Array stays in the buffer, no copy is made
+  template <typename T>
+  const T *TakeArray(size_t count);
+private:
+  const char *data_;
+  size_t size_;
+  size_t pos_ = 0;
+};
+
+// Read-only memory mapping of a whole file
+class MappedFile {
+public:
+  explicit MappedFile(const std::string &path);
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+  ~MappedFile();
+  const char *Data() const;
+  size_t Size() const;
+  Reader MakeReader() const;
+private:
+  void *data_ = nullptr;
+  size_t size_ = 0;
+};
+
+template <typename T>
+void Serialize(const T &pod, std::ostream &out) {
+  static_assert(std::is_trivially_copyable_v<T>, "only trivially copyable values are written as is");
+  out.write(reinterpret_cast<const char *>(&pod), sizeof(pod));
+}
+
+template <typename T>
+void Serialize(const std::vector<T> &data, std::ostream &out) {
+  Serialize(static_cast<uint64_t>(data.size()), out);
+  if constexpr (std::is_trivially_copyable_v<T>) {
+    out.write(reinterpret_cast<const char *>(data.data()), data.size() * sizeof(T));
+  } else {
+    for (const auto &element : data) {
+      Serialize(element, out);
+    }
+  }
+}
+
+template <typename T>
+void Deserialize(Reader &in, T &pod) {
+  static_assert(std::is_trivially_copyable_v<T>, "only trivially copyable values are read as is");
+  std::memcpy(&pod, in.Take(sizeof(pod)), sizeof(pod));
+}
+
+template <typename T>
+void Deserialize(Reader &in, std::vector<T> &data) {
+  uint64_t size = 0;
+  Deserialize(in, size);
+  data.resize(size);
+  if constexpr (std::is_trivially_copyable_v<T>) {
+    if (size > 0) {
+      std::memcpy(data.data(), in.Take(size * sizeof(T)), size * sizeof(T));
+    }
+  } else {
+    for (auto &element : data) {
+      Deserialize(in, element);
+    }
+  }
+}
+
+template <typename T>
+const T *Reader::TakeArray(size_t count) {
+  Align(alignof(T));
+  return reinterpret_cast<const T *>(Take(count * sizeof(T)));
+}
+}
+
+#endif //YANDEXCPLUSPLUS_5_BLACK_1_WEEK_9_TRANSPORT_BOOK_PART_I_SERIALIZATION_H
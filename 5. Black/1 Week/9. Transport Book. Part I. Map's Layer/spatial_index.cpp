@@ -0,0 +1,178 @@
+//
+// Created by ilya on 04.06.2020.
+//
+
+#include "spatial_index.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <queue>
+#include <tuple>
+
+namespace TransportDatabase {
+namespace {
+const double PI = 3.1415926535;
+const double EARTH_RADIUS = 6371 * 1000;
+// Bound is made a bit smaller, so rounding never prunes a point
+// which is exactly at the limit
+const double BOUND_SLACK = 1 - 1e-7;
+}
+
+SpatialIndex::SpatialIndex(const std::vector<std::pair<uint32_t, Coordinates>> &points) {
+  points_.reserve(points.size());
+  for (const auto &[id, coord] : points) {
+    points_.push_back({id, coord, ToSphere(coord)});
+  }
+  boxes_.resize(points_.size());
+  Build(0, points_.size(), 0);
+}
+
+size_t SpatialIndex::Size() const {
+  return points_.size();
+}
+
+SpatialIndex::Vector3 SpatialIndex::ToSphere(Coordinates coord) {
+  const double lat = coord.GetLatitude() * PI / 180.0;
+  const double lon = coord.GetLongitude() * PI / 180.0;
+  return {std::cos(lat) * std::cos(lon), std::cos(lat) * std::sin(lon), std::sin(lat)};
+}
+
+double SpatialIndex::Axis(const Coordinates &coord, size_t depth) {
+  return depth % 2 == 0 ? coord.GetLatitude() : coord.GetLongitude();
+}
+
+void SpatialIndex::Build(size_t begin, size_t end, size_t depth) {
+  if (begin >= end) {
+    return;
+  }
+  const size_t mid = begin + (end - begin) / 2;
+  std::nth_element(points_.begin() + begin, points_.begin() + mid, points_.begin() + end,
+                   [depth](const Point &lhs, const Point &rhs) {
+                     return Axis(lhs.coord, depth) < Axis(rhs.coord, depth);
+                   });
+  Box3 &box = boxes_[mid];
+  box.min = box.max = points_[begin].position;
+  for (size_t idx = begin + 1; idx < end; ++idx) {
+    for (size_t axis = 0; axis < 3; ++axis) {
+      box.min[axis] = std::min(box.min[axis], points_[idx].position[axis]);
+      box.max[axis] = std::max(box.max[axis], points_[idx].position[axis]);
+    }
+  }
+  Build(begin, mid, depth + 1);
+  Build(mid + 1, end, depth + 1);
+}
+
+// Chord to the closest point of the box turned into arc on the Earth
+double SpatialIndex::LowerBound(const Box3 &box, const Vector3 &position) const {
+  double square = 0;
+  for (size_t axis = 0; axis < 3; ++axis) {
+    const double delta = std::max({box.min[axis] - position[axis], 0.0, position[axis] - box.max[axis]});
+    square += delta * delta;
+  }
+  const double chord = std::min(std::sqrt(square), 2.0);
+  return 2 * std::asin(chord / 2) * EARTH_RADIUS * BOUND_SLACK;
+}
+
+// Visits points of the subtree which may be not farther than limit,
+// closer child goes first so that limit shrinks sooner
+template<typename Visit>
+void SpatialIndex::VisitCloser(size_t begin, size_t end, const Vector3 &position,
+                               const double &limit, Visit &visit) const {
+  if (begin >= end) {
+    return;
+  }
+  const size_t mid = begin + (end - begin) / 2;
+  if (LowerBound(boxes_[mid], position) > limit) {
+    return;
+  }
+  visit(points_[mid]);
+  const size_t left_mid = begin + (mid - begin) / 2;
+  const size_t right_mid = mid + 1 + (end - mid - 1) / 2;
+  const double left_bound = begin < mid ? LowerBound(boxes_[left_mid], position) : limit;
+  const double right_bound = mid + 1 < end ? LowerBound(boxes_[right_mid], position) : limit;
+  if (left_bound <= right_bound) {
+    VisitCloser(begin, mid, position, limit, visit);
+    VisitCloser(mid + 1, end, position, limit, visit);
+  } else {
+    VisitCloser(mid + 1, end, position, limit, visit);
+    VisitCloser(begin, mid, position, limit, visit);
+  }
+}
+
+std::vector<SpatialIndex::Found> SpatialIndex::Nearest(Coordinates center, size_t count) const {
+  auto closer = [](const Found &lhs, const Found &rhs) {
+    return std::tie(lhs.distance, lhs.id) < std::tie(rhs.distance, rhs.id);
+  };
+  std::priority_queue<Found, std::vector<Found>, decltype(closer)> farthest(closer);
+  if (count == 0) {
+    return {};
+  }
+  double limit = std::numeric_limits<double>::infinity();
+  auto visit = [&](const Point &point) {
+    const Found found{point.id, Coordinates::Distance(center, point.coord)};
+    if (farthest.size() < count) {
+      farthest.push(found);
+    } else if (closer(found, farthest.top())) {
+      farthest.pop();
+      farthest.push(found);
+    }
+    if (farthest.size() == count) {
+      limit = farthest.top().distance;
+    }
+  };
+  VisitCloser(0, points_.size(), ToSphere(center), limit, visit);
+
+  std::vector<Found> result(farthest.size());
+  for (auto it = result.rbegin(); it != result.rend(); ++it) {
+    *it = farthest.top();
+    farthest.pop();
+  }
+  return result;
+}
+
+std::vector<SpatialIndex::Found> SpatialIndex::WithinRadius(Coordinates center, double radius) const {
+  std::vector<Found> result;
+  auto visit = [&](const Point &point) {
+    const double distance = Coordinates::Distance(center, point.coord);
+    if (distance <= radius) {
+      result.push_back({point.id, distance});
+    }
+  };
+  VisitCloser(0, points_.size(), ToSphere(center), radius, visit);
+  std::sort(result.begin(), result.end(), [](const Found &lhs, const Found &rhs) {
+    return std::tie(lhs.distance, lhs.id) < std::tie(rhs.distance, rhs.id);
+  });
+  return result;
+}
+
+std::vector<uint32_t> SpatialIndex::InBox(Coordinates min_corner, Coordinates max_corner) const {
+  std::vector<uint32_t> result;
+  CollectInBox(0, points_.size(), 0, min_corner, max_corner, result);
+  std::sort(result.begin(), result.end());
+  return result;
+}
+
+void SpatialIndex::CollectInBox(size_t begin, size_t end, size_t depth,
+                                Coordinates min_corner, Coordinates max_corner,
+                                std::vector<uint32_t> &result) const {
+  if (begin >= end) {
+    return;
+  }
+  const size_t mid = begin + (end - begin) / 2;
+  const Point &point = points_[mid];
+  if (point.coord.GetLatitude() >= min_corner.GetLatitude()
+      && point.coord.GetLatitude() <= max_corner.GetLatitude()
+      && point.coord.GetLongitude() >= min_corner.GetLongitude()
+      && point.coord.GetLongitude() <= max_corner.GetLongitude()) {
+    result.push_back(point.id);
+  }
+  const double split = Axis(point.coord, depth);
+  if (Axis(min_corner, depth) <= split) {
+    CollectInBox(begin, mid, depth + 1, min_corner, max_corner, result);
+  }
+  if (Axis(max_corner, depth) >= split) {
+    CollectInBox(mid + 1, end, depth + 1, min_corner, max_corner, result);
+  }
+}
+}
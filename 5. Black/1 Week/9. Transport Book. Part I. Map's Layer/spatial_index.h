@@ -0,0 +1,70 @@
+//
+// Created by ilya on 04.06.2020.
+//
+
+#ifndef YANDEXCPLUSPLUS_5_BLACK_1_WEEK_9_TRANSPORT_BOOK_PART_I_SPATIAL_INDEX_H
+#define YANDEXCPLUSPLUS_5_BLACK_1_WEEK_9_TRANSPORT_BOOK_PART_I_SPATIAL_INDEX_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "coordinates.h"
+
+namespace TransportDatabase {
+// Static k-d tree over points with ids. Nodes split by latitude and
+// longitude in turn, so boxes of coordinates are searched directly.
+// Every node also keeps the box of its points on the unit sphere,
+// which gives a lower bound of great circle distance to them
+class SpatialIndex {
+public:
+  struct Found {
+    uint32_t id;
+    // Meters, same as Coordinates::Distance
+    double distance;
+  };
+
+  SpatialIndex() = default;
+  explicit SpatialIndex(const std::vector<std::pair<uint32_t, Coordinates>> &points);
+
+  size_t Size() const;
+  // At most count closest points, closest first, equal ones by id
+  std::vector<Found> Nearest(Coordinates center, size_t count) const;
+  // Points not farther than radius, closest first
+  std::vector<Found> WithinRadius(Coordinates center, double radius) const;
+  // Points with latitude and longitude between the corners, by id
+  std::vector<uint32_t> InBox(Coordinates min_corner, Coordinates max_corner) const;
+
+private:
+  using Vector3 = std::array<double, 3>;
+  struct Point {
+    uint32_t id;
+    Coordinates coord;
+    Vector3 position;
+  };
+  // Subtree of points in [begin, end) is stored at its middle point
+  struct Box3 {
+    Vector3 min;
+    Vector3 max;
+  };
+
+  static Vector3 ToSphere(Coordinates coord);
+  static double Axis(const Coordinates &coord, size_t depth);
+  void Build(size_t begin, size_t end, size_t depth);
+  double LowerBound(const Box3 &box, const Vector3 &position) const;
+
+  template<typename Visit>
+  void VisitCloser(size_t begin, size_t end, const Vector3 &position,
+                   const double &limit, Visit &visit) const;
+  void CollectInBox(size_t begin, size_t end, size_t depth,
+                    Coordinates min_corner, Coordinates max_corner,
+                    std::vector<uint32_t> &result) const;
+
+  std::vector<Point> points_;
+  std::vector<Box3> boxes_;
+};
+}
+
+#endif //YANDEXCPLUSPLUS_5_BLACK_1_WEEK_9_TRANSPORT_BOOK_PART_I_SPATIAL_INDEX_H
@@ -2,6 +2,7 @@
 // Created by ilya on 07.01.2020.
 //
 
+#include <charconv>
 #include <iostream>
 #include <optional>
 #include <string>
@@ -14,33 +15,68 @@
 
 namespace Svg {
 
-void RenderColor(std::ostream& out, std::monostate) {
+Output& Output::operator<<(double value) {
+  char buffer[32];
+  const auto result = std::to_chars(std::begin(buffer), std::end(buffer), value,
+                                    std::chars_format::general, 6);
+  return *this << std::string_view(buffer, result.ptr - buffer);
+}
+
+Output& Output::Text(std::string_view text) {
+  if (!json_escaped_) {
+    return *this << text;
+  }
+  static const char HEX[] = "0123456789abcdef";
+  size_t plain_begin = 0;
+  for (size_t i = 0; i < text.size(); ++i) {
+    const auto c = static_cast<unsigned char>(text[i]);
+    if (c != '"' && c != '\\' && c >= 0x20) {
+      continue;
+    }
+    out_.append(text.data() + plain_begin, i - plain_begin);
+    plain_begin = i + 1;
+    switch (c) {
+      case '"': out_ += "\\\""; break;
+      case '\\': out_ += "\\\\"; break;
+      case '\n': out_ += "\\n"; break;
+      case '\t': out_ += "\\t"; break;
+      case '\r': out_ += "\\r"; break;
+      default:
+        out_ += "\\u00";
+        out_ += HEX[c >> 4];
+        out_ += HEX[c & 0xF];
+    }
+  }
+  out_.append(text.data() + plain_begin, text.size() - plain_begin);
+  return *this;
+}
+
+void RenderColor(Output& out, std::monostate) {
   out << "none";
 }
 
-void RenderColor(std::ostream& out, const std::string& value) {
-  out << value;
+void RenderColor(Output& out, const std::string& value) {
+  out.Text(value);
 }
 
-void RenderColor(std::ostream& out, Rgb rgb) {
+void RenderColor(Output& out, Rgb rgb) {
   out << "rgb(" << static_cast<int>(rgb.red)
       << "," << static_cast<int>(rgb.green)
       << "," << static_cast<int>(rgb.blue) << ")";
 }
 
-void RenderColor(std::ostream& out, Rgba rgb) {
+void RenderColor(Output& out, Rgba rgb) {
   out << "rgba(" << static_cast<int>(rgb.red)
       << "," << static_cast<int>(rgb.green)
       << "," << static_cast<int>(rgb.blue)
       << "," << rgb.alpha << ")";
 }
 
-void RenderColor(std::ostream& out, const Color& color) {
+void RenderColor(Output& out, const Color& color) {
   visit([&out](const auto& value) { RenderColor(out, value); },
         color);
 }
 
-
 Circle& Circle::SetCenter(Point point) {
   center_ = point;
   return *this;
@@ -50,22 +86,13 @@ Circle& Circle::SetRadius(double radius) {
   return *this;
 }
 
-void Circle::Render(std::ostream& out) const {
-#ifdef JSON_SVG
+void Circle::Render(Output& out) const {
   out << "<circle ";
-  out << R"(cx=\")" << center_.x << R"(\" )";
-  out << R"(cy=\")" << center_.y << R"(\" )";
-  out << R"(r=\")" << radius_ << R"(\" )";
+  out.Attribute("cx", center_.x);
+  out.Attribute("cy", center_.y);
+  out.Attribute("r", radius_);
   PathProps::RenderAttrs(out);
   out << "/>";
-#else
-  out << "<circle ";
-  out << "cx=\"" << center_.x << "\" ";
-  out << "cy=\"" << center_.y << "\" ";
-  out << "r=\"" << radius_ << "\" ";
-  PathProps::RenderAttrs(out);
-  out << "/>";
-#endif
 }
 
 Polyline& Polyline::AddPoint(Point point) {
@@ -73,25 +100,10 @@ Polyline& Polyline::AddPoint(Point point) {
   return *this;
 }
 
-void Polyline::Render(std::ostream& out) const {
-#ifdef JSON_SVG
-  out << "<polyline ";
-  out << R"(points=\")";
-  bool first = true;
-  for (const Point point : points_) {
-    if (first) {
-      first = false;
-    } else {
-      out << " ";
-    }
-    out << point.x << "," << point.y;
-  }
-  out << R"(\" )";
-  PathProps::RenderAttrs(out);
-  out << "/>";
-#else
+void Polyline::Render(Output& out) const {
   out << "<polyline ";
-  out << "points=\"";
+  out << "points=";
+  out.Quote();
   bool first = true;
   for (const Point point : points_) {
     if (first) {
@@ -101,10 +113,9 @@ void Polyline::Render(std::ostream& out) const {
     }
     out << point.x << "," << point.y;
   }
-  out << "\" ";
+  out.Quote() << " ";
   PathProps::RenderAttrs(out);
   out << "/>";
-#endif
 }
 
 Text& Text::SetPoint(Point point) {
@@ -132,36 +143,20 @@ Text& Text::SetData(const std::string& data) {
   return *this;
 }
 
-void Text::Render(std::ostream& out) const {
-#ifdef JSON_SVG
+void Text::Render(Output& out) const {
   out << "<text ";
-  out << R"(x=\")" << point_.x << R"(\" )";
-  out << R"(y=\")" << point_.y << R"(\" )";
-  out << R"(dx=\")" << offset_.x << R"(\" )";
-  out << R"(dy=\")" << offset_.y << R"(\" )";
-  out << R"(font-size=\")" << font_size_ << R"(\" )";
+  out.Attribute("x", point_.x);
+  out.Attribute("y", point_.y);
+  out.Attribute("dx", offset_.x);
+  out.Attribute("dy", offset_.y);
+  out.Attribute("font-size", font_size_);
   if (font_family_) {
-    out << R"(font-family=\")" << *font_family_ << R"(\" )";
+    out.Attribute("font-family", *font_family_);
   }
   PathProps::RenderAttrs(out);
   out << ">";
-  out << data_;
+  out.Text(data_);
   out << "</text>";
-#else
-  out << "<text ";
-  out << "x=\"" << point_.x << "\" ";
-  out << "y=\"" << point_.y << "\" ";
-  out << "dx=\"" << offset_.x << "\" ";
-  out << "dy=\"" << offset_.y << "\" ";
-  out << "font-size=\"" << font_size_ << "\" ";
-  if (font_family_) {
-    out << "font-family=\"" << *font_family_ << "\" ";
-  }
-  PathProps::RenderAttrs(out);
-  out << ">";
-  out << data_;
-  out << "</text>";
-#endif
 }
 
 ExtendedText ExtendedText::SetFontWidth(const std::string &str) {
@@ -169,57 +164,39 @@ ExtendedText ExtendedText::SetFontWidth(const std::string &str) {
   return *this;
 }
 
-void ExtendedText::Render(std::ostream &out) const {
-#ifdef JSON_SVG
+void ExtendedText::Render(Output& out) const {
   out << "<text ";
-  out << R"(x=\")" << point_.x << R"(\" )";
-  out << R"(y=\")" << point_.y << R"(\" )";
-  out << R"(dx=\")" << offset_.x << R"(\" )";
-  out << R"(dy=\")" << offset_.y << R"(\" )";
-  out << R"(font-size=\")" << font_size_ << R"(\" )";
+  out.Attribute("x", point_.x);
+  out.Attribute("y", point_.y);
+  out.Attribute("dx", offset_.x);
+  out.Attribute("dy", offset_.y);
+  out.Attribute("font-size", font_size_);
   if (font_family_) {
-    out << R"(font-family=\")" << *font_family_ << R"(\" )";
+    out.Attribute("font-family", *font_family_);
   }
   TextProps::RenderAttrs(out);
   PathProps::RenderAttrs(out);
   out << ">";
-  out << data_;
+  out.Text(data_);
   out << "</text>";
-#else
-  out << "<text ";
-  out << "x=\"" << point_.x << "\" ";
-  out << "y=\"" << point_.y << "\" ";
-  out << "dx=\"" << offset_.x << "\" ";
-  out << "dy=\"" << offset_.y << "\" ";
-  out << "font-size=\"" << font_size_ << "\" ";
-  if (font_family_) {
-    out << "font-family=\"" << *font_family_ << "\" ";
-  }
-  TextProps::RenderAttrs(out);
-  PathProps::RenderAttrs(out);
-  out << ">";
-  out << data_;
-  out << "</text>";
-#endif
 }
 
 
-void Document::Render(std::ostream& out) const {
-#ifdef JSON_SVG
-  out << R"(<?xml version=\"1.0\" encoding=\"UTF-8\" ?>)";
-  out << R"(<svg xmlns=\"http://www.w3.org/2000/svg\" version=\"1.1\">)";
-  for (const auto& object_ptr : objects_) {
-    object_ptr->Render(out);
-  }
-  out << "</svg>";
-#else
-  out << "<?xml version=\"1.0\" encoding=\"UTF-8\" ?>";
-  out << "<svg xmlns=\"http://www.w3.org/2000/svg\" version=\"1.1\">";
+void Document::Render(Output& out) const {
+  out << "<?xml version=";
+  out.Quote() << "1.0";
+  out.Quote() << " encoding=";
+  out.Quote() << "UTF-8";
+  out.Quote() << " ?>";
+  out << "<svg xmlns=";
+  out.Quote() << "http://www.w3.org/2000/svg";
+  out.Quote() << " version=";
+  out.Quote() << "1.1";
+  out.Quote() << ">";
   for (const auto& object_ptr : objects_) {
     object_ptr->Render(out);
   }
   out << "</svg>";
-#endif
 }
 
 void Document::Clear() {
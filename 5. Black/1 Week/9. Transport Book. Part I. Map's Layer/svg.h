@@ -5,9 +5,12 @@
 #ifndef YANDEXCPLUSPLUS_5_BLACK_1_WEEK_7_TRANSPORT_BOOK_PART_G_MAP_SVG_H
 #define YANDEXCPLUSPLUS_5_BLACK_1_WEEK_7_TRANSPORT_BOOK_PART_G_MAP_SVG_H
 
+#include <charconv>
 #include <iostream>
 #include <optional>
 #include <string>
+#include <string_view>
+#include <type_traits>
 #include <utility>
 #include <variant>
 #include <vector>
@@ -37,11 +40,55 @@ struct Rgba {
 using Color = std::variant<std::monostate, std::string, Rgb, Rgba>;
 const Color NoneColor{};
 
-void RenderColor(std::ostream& out, std::monostate);
-void RenderColor(std::ostream& out, const std::string& value);
-void RenderColor(std::ostream& out, Rgb rgb);
-void RenderColor(std::ostream& out, Rgba rgb);
-void RenderColor(std::ostream& out, const Color& color);
+#ifdef JSON_SVG
+constexpr bool JSON_ESCAPED = true;
+#else
+constexpr bool JSON_ESCAPED = false;
+#endif
+
+// Appends svg right to the string. With json_escaped quotes and
+// text are escaped, so the result can be put into a JSON string
+// as is. Numbers are formatted like ostream does by default (%g)
+class Output {
+public:
+  explicit Output(std::string& out, bool json_escaped = JSON_ESCAPED)
+      : out_(out), json_escaped_(json_escaped) {}
+
+  // Markup without quotes and user text
+  Output& operator<<(std::string_view markup) {
+    out_ += markup;
+    return *this;
+  }
+  Output& operator<<(const char* markup) {
+    return *this << std::string_view(markup);
+  }
+  Output& operator<<(char c) {
+    out_ += c;
+    return *this;
+  }
+  Output& operator<<(double value);
+  template <typename Integer, typename = std::enable_if_t<std::is_integral_v<Integer>>>
+  Output& operator<<(Integer value);
+
+  Output& Quote() {
+    return *this << (json_escaped_ ? "\\\"" : "\"");
+  }
+  Output& Text(std::string_view text);
+
+  // name="value" followed by space
+  template <typename Value>
+  Output& Attribute(std::string_view name, const Value& value);
+
+private:
+  std::string& out_;
+  bool json_escaped_;
+};
+
+void RenderColor(Output& out, std::monostate);
+void RenderColor(Output& out, const std::string& value);
+void RenderColor(Output& out, Rgb rgb);
+void RenderColor(Output& out, Rgba rgb);
+void RenderColor(Output& out, const Color& color);
 
 class Object;
 using SvgObjectHolder = std::unique_ptr<Object>;
@@ -52,7 +99,7 @@ SvgObjectHolder MakeSvgObject(ObjectType object) {
 
 class Object {
 public:
-  virtual void Render(std::ostream& out) const = 0;
+  virtual void Render(Output& out) const = 0;
   virtual ~Object() = default;
 };
 
@@ -84,36 +131,16 @@ public:
     return AsOwner();
   }
 
-  void RenderAttrs(std::ostream& out) const {
-#ifdef JSON_SVG
-    out << R"(fill=\")";
-    RenderColor(out, fill_color_);
-    out << R"(\" )";
-    out << R"(stroke=\")";
-    RenderColor(out, stroke_color_);
-    out << R"(\" )";
-    out << R"(stroke-width=\")" << stroke_width_ << R"(\" )";
+  void RenderAttrs(Output& out) const {
+    out.Attribute("fill", fill_color_);
+    out.Attribute("stroke", stroke_color_);
+    out.Attribute("stroke-width", stroke_width_);
     if (stroke_line_cap_) {
-      out << R"(stroke-linecap=\")" << *stroke_line_cap_ << R"(\" )";
+      out.Attribute("stroke-linecap", *stroke_line_cap_);
     }
     if (stroke_line_join_) {
-      out << R"(stroke-linejoin=\")" << *stroke_line_join_ << R"(\" )";
+      out.Attribute("stroke-linejoin", *stroke_line_join_);
     }
-#else
-    out << "fill=\"";
-    RenderColor(out, fill_color_);
-    out << "\" ";
-    out << "stroke=\"";
-    RenderColor(out, stroke_color_);
-    out << "\" ";
-    out << "stroke-width=\"" << stroke_width_ << "\" ";
-    if (stroke_line_cap_) {
-      out << "stroke-linecap=\"" << *stroke_line_cap_ << "\" ";
-    }
-    if (stroke_line_join_) {
-      out << "stroke-linejoin=\"" << *stroke_line_join_ << "\" ";
-    }
-#endif
   }
 
 private:
@@ -136,17 +163,8 @@ public:
     font_weight = param;
     return AsOwner();
   }
-  void RenderAttrs(std::ostream& out) const {
-#ifdef JSON_SVG
-    out << R"(font-weight=\")";
-    RenderColor(out, font_weight);
-    out << R"(\" )";
-#else
-    out << "font-weight=\"";
-    RenderColor(out, font_weight);
-    out << "\" ";
-#endif
-
+  void RenderAttrs(Output& out) const {
+    out.Attribute("font-weight", font_weight);
   }
 private:
   std::string font_weight;
@@ -159,7 +177,7 @@ class Circle : public Object, public PathProps<Circle> {
 public:
   Circle& SetCenter(Point point);
   Circle& SetRadius(double radius);
-  void Render(std::ostream& out) const override;
+  void Render(Output& out) const override;
 private:
   Point center_;
   double radius_ = 1;
@@ -168,7 +186,7 @@ private:
 class Polyline : public Object, public PathProps<Polyline> {
 public:
   Polyline& AddPoint(Point point);
-  void Render(std::ostream& out) const override;
+  void Render(Output& out) const override;
 private:
   std::vector<Point> points_;
 };
@@ -180,7 +198,7 @@ public:
   Text& SetFontSize(uint32_t size);
   Text&SetFontFamily(const std::string& value);
   Text& SetData(const std::string& data);
-  void Render(std::ostream& out) const override;
+  void Render(Output& out) const override;
 
 protected:
   Point point_;
@@ -193,7 +211,7 @@ protected:
 class ExtendedText : public Text, public TextProps<ExtendedText> {
 public:
   ExtendedText SetFontWidth(const std::string& str);
-  void Render(std::ostream& out) const override;
+  void Render(Output& out) const override;
 private:
   std::string font_width;
 };
@@ -208,11 +226,34 @@ public:
   void AddDocPart(ObjectPtr object) {
     objects_.push_back(std::move(object));
   }
-  void Render(std::ostream& out) const override;
+  void Render(Output& out) const override;
   void Clear();
 private:
   std::vector<SvgObjectHolder> objects_;
 };
+
+
+template <typename Integer, typename>
+Output& Output::operator<<(Integer value) {
+  char buffer[24];
+  const auto result = std::to_chars(std::begin(buffer), std::end(buffer), value);
+  return *this << std::string_view(buffer, result.ptr - buffer);
+}
+
+template <typename Value>
+Output& Output::Attribute(std::string_view name, const Value& value) {
+  *this << name << '=';
+  Quote();
+  if constexpr (std::is_same_v<Value, Color>) {
+    RenderColor(*this, value);
+  } else if constexpr (std::is_convertible_v<const Value&, std::string_view>) {
+    Text(value);
+  } else {
+    *this << value;
+  }
+  Quote();
+  return *this << ' ';
+}
 }
 
 #endif //YANDEXCPLUSPLUS_5_BLACK_1_WEEK_7_TRANSPORT_BOOK_PART_G_MAP_SVG_H
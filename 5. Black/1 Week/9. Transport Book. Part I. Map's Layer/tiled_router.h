@@ -0,0 +1,237 @@
+#pragma once
+
+#include "graph.h"
+#include "base_router.h"
+#include "serialization.h"
+
+#include <algorithm>
+#include <cassert>
+#include <condition_variable>
+#include <limits>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace Graph {
+
+  // Same all-pairs table as Router, but weights and previous edges are kept
+  // in two flat row-major arrays with sentinels instead of optional values.
+  // Floyd–Warshall still goes through the intermediate vertices one by one,
+  // so every cell is relaxed in the same order and routes are bit-identical
+  // to Router. For each intermediate vertex rows are split between worker
+  // threads and processed by column tiles, which keeps the needed part of
+  // the intermediate row in cache.
+  template <typename Weight>
+  class TiledRouter : public BaseRouter<Weight> {
+  private:
+    using Graph = DirectedWeightedGraph<Weight>;
+
+  public:
+    // thread_count = 0 means one thread per hardware core
+    explicit TiledRouter(const Graph& graph, size_t thread_count = 0);
+    // Uses table saved by Save right from the reader buffer, which
+    // has to outlive the router
+    TiledRouter(const Graph& graph, Serialization::Reader& in);
+
+    void Save(std::ostream& out) const;
+
+    using typename BaseRouter<Weight>::RouteId;
+    using typename BaseRouter<Weight>::RouteInfo;
+
+    std::optional<Weight> BuildRouteEdges(VertexId from, VertexId to, std::vector<EdgeId>& edges) const override;
+    std::vector<std::optional<Weight>> BuildWeightMatrix(const std::vector<VertexId>& sources,
+                                                         const std::vector<VertexId>& targets) const override;
+
+  private:
+    static constexpr EdgeId NO_EDGE = std::numeric_limits<EdgeId>::max();
+    static constexpr Weight NO_WEIGHT = std::numeric_limits<Weight>::has_infinity
+                                        ? std::numeric_limits<Weight>::infinity()
+                                        : std::numeric_limits<Weight>::max();
+    static constexpr size_t TILE_SIZE = 256;
+
+    // Threads wait here until all of them finish the current vertex
+    class Barrier {
+    public:
+      explicit Barrier(size_t count) : count_(count) {}
+      void Wait();
+    private:
+      std::mutex mutex_;
+      std::condition_variable condition_;
+      size_t count_;
+      size_t waiting_ = 0;
+      size_t generation_ = 0;
+    };
+
+    size_t Index(VertexId from, VertexId to) const {
+      return from * vertex_count_ + to;
+    }
+
+    void InitializeRoutesInternalData(const Graph& graph);
+    void RelaxRows(VertexId row_begin, VertexId row_end, VertexId vertex_through);
+    void RelaxAllRoutes(size_t thread_count);
+
+    const Graph& graph_;
+    size_t vertex_count_;
+    std::vector<Weight> weights_;
+    std::vector<EdgeId> prev_edges_;
+    // Point either to own tables or to the loaded ones
+    const Weight* weights_data_ = nullptr;
+    const EdgeId* prev_edges_data_ = nullptr;
+  };
+
+
+  template <typename Weight>
+  void TiledRouter<Weight>::Barrier::Wait() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    const size_t generation = generation_;
+    if (++waiting_ == count_) {
+      waiting_ = 0;
+      ++generation_;
+      condition_.notify_all();
+    } else {
+      condition_.wait(lock, [this, generation] { return generation != generation_; });
+    }
+  }
+
+  template <typename Weight>
+  TiledRouter<Weight>::TiledRouter(const Graph& graph, size_t thread_count)
+      : graph_(graph),
+        vertex_count_(graph.GetVertexCount()),
+        weights_(vertex_count_ * vertex_count_, NO_WEIGHT),
+        prev_edges_(vertex_count_ * vertex_count_, NO_EDGE)
+  {
+    if (thread_count == 0) {
+      thread_count = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+    }
+    InitializeRoutesInternalData(graph);
+    RelaxAllRoutes(std::min(thread_count, std::max<size_t>(vertex_count_, 1)));
+    weights_data_ = weights_.data();
+    prev_edges_data_ = prev_edges_.data();
+  }
+
+  template <typename Weight>
+  TiledRouter<Weight>::TiledRouter(const Graph& graph, Serialization::Reader& in)
+      : graph_(graph),
+        vertex_count_(graph.GetVertexCount())
+  {
+    uint64_t vertex_count = 0;
+    Serialization::Deserialize(in, vertex_count);
+    if (vertex_count != vertex_count_) {
+      throw std::runtime_error("routes table does not match graph");
+    }
+    weights_data_ = in.TakeArray<Weight>(vertex_count_ * vertex_count_);
+    prev_edges_data_ = in.TakeArray<EdgeId>(vertex_count_ * vertex_count_);
+  }
+
+  template <typename Weight>
+  void TiledRouter<Weight>::Save(std::ostream& out) const {
+    Serialization::Serialize(static_cast<uint64_t>(vertex_count_), out);
+    Serialization::Align(out, alignof(Weight));
+    out.write(reinterpret_cast<const char*>(weights_data_), vertex_count_ * vertex_count_ * sizeof(Weight));
+    Serialization::Align(out, alignof(EdgeId));
+    out.write(reinterpret_cast<const char*>(prev_edges_data_), vertex_count_ * vertex_count_ * sizeof(EdgeId));
+  }
+
+  template <typename Weight>
+  void TiledRouter<Weight>::InitializeRoutesInternalData(const Graph& graph) {
+    for (VertexId vertex = 0; vertex < vertex_count_; ++vertex) {
+      weights_[Index(vertex, vertex)] = 0;
+      for (const EdgeId edge_id : graph.GetIncidentEdges(vertex)) {
+        const auto& edge = graph.GetEdge(edge_id);
+        assert(edge.weight >= 0);
+        const size_t idx = Index(vertex, edge.to);
+        if (weights_[idx] == NO_WEIGHT || weights_[idx] > edge.weight) {
+          weights_[idx] = edge.weight;
+          prev_edges_[idx] = edge_id;
+        }
+      }
+    }
+  }
+
+  // Row of vertex_through does not change while relaxing through it, because
+  // its weight to itself is zero, so rows can be processed concurrently
+  template <typename Weight>
+  void TiledRouter<Weight>::RelaxRows(VertexId row_begin, VertexId row_end, VertexId vertex_through) {
+    const Weight* through_weights = &weights_[Index(vertex_through, 0)];
+    const EdgeId* through_edges = &prev_edges_[Index(vertex_through, 0)];
+    for (VertexId tile_begin = 0; tile_begin < vertex_count_; tile_begin += TILE_SIZE) {
+      const VertexId tile_end = std::min(tile_begin + TILE_SIZE, vertex_count_);
+      for (VertexId vertex_from = row_begin; vertex_from < row_end; ++vertex_from) {
+        const Weight weight_from = weights_[Index(vertex_from, vertex_through)];
+        if (weight_from == NO_WEIGHT) {
+          continue;
+        }
+        const EdgeId edge_from = prev_edges_[Index(vertex_from, vertex_through)];
+        Weight* row_weights = &weights_[Index(vertex_from, 0)];
+        EdgeId* row_edges = &prev_edges_[Index(vertex_from, 0)];
+        for (VertexId vertex_to = tile_begin; vertex_to < tile_end; ++vertex_to) {
+          if (through_weights[vertex_to] == NO_WEIGHT) {
+            continue;
+          }
+          const Weight candidate_weight = weight_from + through_weights[vertex_to];
+          if (candidate_weight < row_weights[vertex_to]) {
+            row_weights[vertex_to] = candidate_weight;
+            row_edges[vertex_to] = through_edges[vertex_to] != NO_EDGE ? through_edges[vertex_to] : edge_from;
+          }
+        }
+      }
+    }
+  }
+
+  template <typename Weight>
+  void TiledRouter<Weight>::RelaxAllRoutes(size_t thread_count) {
+    Barrier barrier(thread_count);
+    const size_t rows_per_thread = (vertex_count_ + thread_count - 1) / std::max<size_t>(thread_count, 1);
+    auto worker = [this, &barrier, rows_per_thread](size_t thread_idx) {
+      const VertexId row_begin = std::min(thread_idx * rows_per_thread, vertex_count_);
+      const VertexId row_end = std::min(row_begin + rows_per_thread, vertex_count_);
+      for (VertexId vertex_through = 0; vertex_through < vertex_count_; ++vertex_through) {
+        RelaxRows(row_begin, row_end, vertex_through);
+        barrier.Wait();
+      }
+    };
+    std::vector<std::thread> threads;
+    for (size_t thread_idx = 1; thread_idx < thread_count; ++thread_idx) {
+      threads.emplace_back(worker, thread_idx);
+    }
+    worker(0);
+    for (auto& thread : threads) {
+      thread.join();
+    }
+  }
+
+  template <typename Weight>
+  std::optional<Weight> TiledRouter<Weight>::BuildRouteEdges(VertexId from, VertexId to,
+                                                             std::vector<EdgeId>& edges) const {
+    edges.clear();
+    const Weight weight = weights_data_[Index(from, to)];
+    if (weight == NO_WEIGHT) {
+      return std::nullopt;
+    }
+    for (EdgeId edge_id = prev_edges_data_[Index(from, to)];
+         edge_id != NO_EDGE;
+         edge_id = prev_edges_data_[Index(from, graph_.GetEdge(edge_id).from)]) {
+      edges.push_back(edge_id);
+    }
+    std::reverse(std::begin(edges), std::end(edges));
+    return weight;
+  }
+
+  template <typename Weight>
+  std::vector<std::optional<Weight>> TiledRouter<Weight>::BuildWeightMatrix(const std::vector<VertexId>& sources,
+                                                                            const std::vector<VertexId>& targets) const {
+    std::vector<std::optional<Weight>> weights;
+    weights.reserve(sources.size() * targets.size());
+    for (const VertexId from : sources) {
+      for (const VertexId to : targets) {
+        const Weight weight = weights_data_[Index(from, to)];
+        weights.push_back(weight == NO_WEIGHT ? std::nullopt : std::optional<Weight>(weight));
+      }
+    }
+    return weights;
+  }
+
+}